@@ -27,13 +27,13 @@
 //  Use the standard classes for std::, if available.
 #include <condition_variable>
 
-#include <cassert>
 #include <chrono>
 #include <system_error>
 
 #include <sdkddkver.h>  //  Detect Windows version.
-#if (WINVER < _WIN32_WINNT_VISTA)
+#if (WINVER < _WIN32_WINNT_VISTA) || (WINVER >= _WIN32_WINNT_WIN8)
 #include <atomic>
+#include <cstdint>
 #endif
 #if (defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
 #pragma message "The Windows API that MinGW-w32 provides is not fully compatible\
@@ -43,14 +43,14 @@
 #else
 #if (WINVER < _WIN32_WINNT_VISTA)
 #include <windef.h>
-#include <winbase.h>  //  For CreateSemaphore
-#include <handleapi.h>
+#include <winbase.h>
 #endif
 #include <synchapi.h>
 #endif
 
 #include "mingw.mutex.h"
 #include "mingw.shared_mutex.h"
+#include "mingw.precise_sleep.h"
 
 #if !defined(_WIN32_WINNT) || (_WIN32_WINNT < 0x0501)
 #error To use the MinGW-std-threads library, you will need to define the macro _WIN32_WINNT to be 0x0501 (Windows XP) or higher.
@@ -63,83 +63,179 @@ enum class cv_status { no_timeout, timeout };
 #else
 using std::cv_status;
 #endif
-namespace xp
+namespace detail
 {
-//    Include the XP-compatible condition_variable classes only if actually
-//  compiling for XP. The XP-compatible classes are slower than the newer
-//  versions, and depend on features not compatible with Windows Phone 8.
-#if (WINVER < _WIN32_WINNT_VISTA)
-class condition_variable_any
+//    Releases a lock entirely before a wait, and takes it back afterwards. A
+//  recursive mutex is unlocked as many times as the thread had locked it.
+struct lock_releaser
 {
-    recursive_mutex mMutex {};
-    std::atomic<int> mNumWaiters {0};
-    HANDLE mSemaphore;
-    HANDLE mWakeEvent {};
-public:
-    using native_handle_type = HANDLE;
-    native_handle_type native_handle()
+    template<class L>
+    static DWORD release (L & lock)
     {
-        return mSemaphore;
+        lock.unlock();
+        return 1;
     }
-    condition_variable_any(const condition_variable_any&) = delete;
-    condition_variable_any& operator=(const condition_variable_any&) = delete;
-    condition_variable_any()
-        :   mSemaphore(CreateSemaphoreA(NULL, 0, 0xFFFF, NULL))
+    template<class L>
+    static void reacquire (L & lock, DWORD)
     {
-        if (mSemaphore == NULL)
-            throw std::system_error(GetLastError(), std::generic_category());
-        mWakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
-        if (mWakeEvent == NULL)
-        {
-            CloseHandle(mSemaphore);
-            throw std::system_error(GetLastError(), std::generic_category());
-        }
+        lock.lock();
     }
-    ~condition_variable_any()
+    static DWORD release (xp::recursive_mutex & lock)
     {
-        CloseHandle(mWakeEvent);
-        CloseHandle(mSemaphore);
+        return unlock_times(lock, lock.native_handle()->RecursionCount);
     }
+    static void reacquire (xp::recursive_mutex & lock, DWORD depth)
+    {
+        lock_times(lock, depth);
+    }
+    static DWORD release (unique_lock<xp::recursive_mutex> & lock)
+    {
+        return release(*lock.mutex());
+    }
+    static void reacquire (unique_lock<xp::recursive_mutex> & lock, DWORD depth)
+    {
+        reacquire(*lock.mutex(), depth);
+    }
+#if (WINVER >= _WIN32_WINNT_WIN7)
+    static DWORD release (windows7::recursive_mutex & lock)
+    {
+        return unlock_times(lock, lock.mRecursionCount);
+    }
+    static void reacquire (windows7::recursive_mutex & lock, DWORD depth)
+    {
+        lock_times(lock, depth);
+    }
+    static DWORD release (unique_lock<windows7::recursive_mutex> & lock)
+    {
+        return release(*lock.mutex());
+    }
+    static void reacquire (unique_lock<windows7::recursive_mutex> & lock, DWORD depth)
+    {
+        reacquire(*lock.mutex(), depth);
+    }
+#endif
 private:
-    template <class M>
-    bool wait_impl(M& lock, DWORD timeout)
+    template<class M>
+    static DWORD unlock_times (M & mutex, DWORD depth)
     {
-        {
-            lock_guard<recursive_mutex> guard(mMutex);
-            mNumWaiters++;
-        }
-        lock.unlock();
-        DWORD ret = WaitForSingleObject(mSemaphore, timeout);
+        for (DWORD i = 0; i < depth; ++i)
+            mutex.unlock();
+        return depth;
+    }
+    template<class M>
+    static void lock_times (M & mutex, DWORD depth)
+    {
+        for (DWORD i = 0; i < depth; ++i)
+            mutex.lock();
+    }
+};
 
-        mNumWaiters--;
-        SetEvent(mWakeEvent);
-        lock.lock();
-        if (ret == WAIT_OBJECT_0)
-            return true;
-        else if (ret == WAIT_TIMEOUT)
-            return false;
-//2 possible cases:
-//1)The point in notify_all() where we determine the count to
-//increment the semaphore with has not been reached yet:
-//we just need to decrement mNumWaiters, but setting the event does not hurt
-//
-//2)Semaphore has just been released with mNumWaiters just before
-//we decremented it. This means that the semaphore count
-//after all waiters finish won't be 0 - because not all waiters
-//woke up by acquiring the semaphore - we woke up by a timeout.
-//The notify_all() must handle this gracefully
-//
-        else
+//  Sleeps until `deadline` with `lock` released, on behalf of `condition`.
+template<class L>
+void sleep_unlocked (void const * condition, L & lock,
+                     std::chrono::steady_clock::time_point deadline)
+{
+    DWORD depth = lock_releaser::release(lock);
+    profiled_wait(condition, [deadline] { sleep_precisely_until(deadline); });
+    lock_releaser::reacquire(lock, depth);
+}
+
+//    The timed waits of every condition variable. The remaining time is taken
+//  from the deadline's own clock before each sleep, so that a sleep which ends
+//  early, or a clock that is adjusted, is accounted for, and it is rounded up,
+//  so that no sleep ends before the deadline.
+//    `wait(ms)` sleeps for a number of milliseconds, and returns whether it was
+//  woken before the timeout. Once less than a millisecond remains, which the
+//  system cannot time, `nap(deadline)` sleeps precisely instead, and returns
+//  whether it noticed a notification.
+template<class Clock, class Duration, class Wait, class Nap>
+cv_status wait_until_deadline (const std::chrono::time_point<Clock, Duration> & abs_time,
+                               Wait && wait, Nap && nap)
+{
+    using namespace std::chrono;
+//  One less than INFINITE.
+    constexpr DWORD kMaxTimeout = 0xfffffffel;
+    for (;;)
+    {
+        auto remaining = abs_time - Clock::now();
+        if (remaining <= remaining.zero())
+            return cv_status::timeout;
+        if (remaining < milliseconds(1))
         {
-            using namespace std;
-            throw system_error(make_error_code(errc::protocol_error));
+            auto step = duration_cast<steady_clock::duration>(remaining);
+            if (step < remaining)
+                ++step;
+            if (nap(steady_clock::now() + step))
+                return cv_status::no_timeout;
+            continue;
         }
+        auto ms = duration_cast<milliseconds>(remaining);
+        if (ms < remaining)
+            ++ms;
+        DWORD timeout = (ms.count() < kMaxTimeout) ? static_cast<DWORD>(ms.count())
+                                                   : kMaxTimeout;
+        if (wait(timeout))
+            return cv_status::no_timeout;
+    }
+}
+
+#if (WINVER < _WIN32_WINNT_VISTA) || (WINVER >= _WIN32_WINNT_WIN8)
+//    Waiters sleep on a 32-bit sequence number, which each notification
+//  advances. A waiter samples the number before it releases the lock, so a
+//  notification that arrives between the release and the sleep changes the
+//  number and is not lost. Notifiers never wait for the waiters to wake, and
+//  the sleeping is done by WaitOnAddress, or by the wait queues that emulate it
+//  before Windows 8, so the condition variable owns no kernel object.
+//    Nothing is assumed about the lock, beyond its lock and unlock functions,
+//  so any Lockable may be used, including shared locks. Recursive mutexes are
+//  released down to no ownership while the thread sleeps.
+//    The number of waiters lets a notification skip the wait queues when no
+//  thread is waiting. A waiter counts itself before it samples the sequence,
+//  and a notifier advances the sequence before it reads the count, so one of
+//  the two always sees the other.
+class sequence_condition_variable_any
+{
+    static constexpr DWORD kInfinite = 0xffffffffl;
+    std::atomic<std::uint32_t> mSequence {0};
+    std::atomic<std::uint32_t> mNumWaiters {0};
+public:
+    using native_handle_type = std::atomic<std::uint32_t> *;
+    native_handle_type native_handle()
+    {
+        return &mSequence;
+    }
+    sequence_condition_variable_any(const sequence_condition_variable_any&) = delete;
+    sequence_condition_variable_any& operator=(const sequence_condition_variable_any&) = delete;
+    sequence_condition_variable_any() = default;
+    ~sequence_condition_variable_any() = default;
+private:
+    template <class L>
+    bool wait_impl(L& lock, DWORD timeout)
+    {
+        mNumWaiters.fetch_add(1, std::memory_order_seq_cst);
+        std::uint32_t sequence = mSequence.load(std::memory_order_seq_cst);
+        DWORD depth = lock_releaser::release(lock);
+        bool success = profiled_wait(this, [this, sequence, timeout] {
+                return wait_on_address(mSequence, sequence, timeout);
+            });
+        mNumWaiters.fetch_sub(1, std::memory_order_relaxed);
+        lock_releaser::reacquire(lock, depth);
+        return success;
+    }
+//    Sleeps through the last fraction of a millisecond, and reports whether a
+//  notification arrived meanwhile.
+    template <class L>
+    bool nap_impl(L& lock, std::chrono::steady_clock::time_point deadline)
+    {
+        std::uint32_t sequence = mSequence.load(std::memory_order_seq_cst);
+        sleep_unlocked(this, lock, deadline);
+        return mSequence.load(std::memory_order_relaxed) != sequence;
     }
 public:
     template <class M>
     void wait(M& lock)
     {
-        wait_impl(lock, INFINITE);
+        wait_impl(lock, kInfinite);
     }
     template <class M, class Predicate>
     void wait(M& lock, Predicate pred)
@@ -152,62 +248,38 @@ public:
 
     void notify_all() noexcept
     {
-        lock_guard<recursive_mutex> lock(mMutex); //block any further wait requests until all current waiters are unblocked
-        if (mNumWaiters.load() <= 0)
-            return;
-
-        ReleaseSemaphore(mSemaphore, mNumWaiters, NULL);
-        while(mNumWaiters > 0)
-        {
-            auto ret = WaitForSingleObject(mWakeEvent, 1000);
-            if (ret == WAIT_FAILED || ret == WAIT_ABANDONED)
-                std::terminate();
-        }
-        assert(mNumWaiters == 0);
-//in case some of the waiters timed out just after we released the
-//semaphore by mNumWaiters, it won't be zero now, because not all waiters
-//woke up by acquiring the semaphore. So we must zero the semaphore before
-//we accept waiters for the next event
-//See _wait_impl for details
-        while(WaitForSingleObject(mSemaphore, 0) == WAIT_OBJECT_0);
+        mSequence.fetch_add(1, std::memory_order_seq_cst);
+        if (mNumWaiters.load(std::memory_order_seq_cst) != 0)
+            wake_by_address_all(mSequence);
     }
     void notify_one() noexcept
     {
-        lock_guard<recursive_mutex> lock(mMutex);
-        int targetWaiters = mNumWaiters.load() - 1;
-        if (targetWaiters <= -1)
-            return;
-        ReleaseSemaphore(mSemaphore, 1, NULL);
-        while(mNumWaiters > targetWaiters)
-        {
-            auto ret = WaitForSingleObject(mWakeEvent, 1000);
-            if (ret == WAIT_FAILED || ret == WAIT_ABANDONED)
-                std::terminate();
-        }
-        assert(mNumWaiters == targetWaiters);
+        mSequence.fetch_add(1, std::memory_order_seq_cst);
+        if (mNumWaiters.load(std::memory_order_seq_cst) != 0)
+            wake_by_address_single(mSequence);
     }
     template <class M, class Rep, class Period>
     cv_status wait_for(M& lock,
                        const std::chrono::duration<Rep, Period>& rel_time)
     {
-        using namespace std::chrono;
-        auto timeout = duration_cast<milliseconds>(rel_time).count();
-        DWORD waittime = (timeout < INFINITE) ? ((timeout < 0) ? 0 : static_cast<DWORD>(timeout)) : (INFINITE - 1);
-        bool ret = wait_impl(lock, waittime) || (timeout >= INFINITE);
-        return ret?cv_status::no_timeout:cv_status::timeout;
+        return wait_until(lock, deadline_after(rel_time));
     }
 
     template <class M, class Rep, class Period, class Predicate>
     bool wait_for(M& lock,
                   const std::chrono::duration<Rep, Period>& rel_time, Predicate pred)
     {
-        return wait_until(lock, std::chrono::steady_clock::now()+rel_time, pred);
+        return wait_until(lock, deadline_after(rel_time), std::move(pred));
     }
     template <class M, class Clock, class Duration>
     cv_status wait_until (M& lock,
                           const std::chrono::time_point<Clock,Duration>& abs_time)
     {
-        return wait_for(lock, abs_time - Clock::now());
+        return wait_until_deadline(abs_time,
+            [this, &lock] (DWORD ms) { return wait_impl(lock, ms); },
+            [this, &lock] (std::chrono::steady_clock::time_point deadline) {
+                return nap_impl(lock, deadline);
+            });
     }
     template <class M, class Clock, class Duration, class Predicate>
     bool wait_until (M& lock,
@@ -224,9 +296,10 @@ public:
         return true;
     }
 };
-class condition_variable: condition_variable_any
+//  The same, restricted to the lock type of std::condition_variable.
+class sequence_condition_variable: sequence_condition_variable_any
 {
-    using base = condition_variable_any;
+    using base = sequence_condition_variable_any;
 public:
     using base::native_handle_type;
     using base::native_handle;
@@ -263,6 +336,17 @@ public:
         return base::wait_until(lock, abs_time, pred);
     }
 };
+#endif
+} //  Namespace mingw_stdthread::detail
+
+namespace xp
+{
+//    Include the XP-compatible condition_variable classes only if actually
+//  compiling for XP. The XP-compatible classes are slower than the newer
+//  versions, and depend on features not compatible with Windows Phone 8.
+#if (WINVER < _WIN32_WINNT_VISTA)
+using condition_variable_any = detail::sequence_condition_variable_any;
+using condition_variable = detail::sequence_condition_variable;
 #endif  //  Compiling for XP
 } //  Namespace mingw_stdthread::xp
 
@@ -277,45 +361,100 @@ class condition_variable
 #pragma GCC diagnostic ignored "-Wzero-as-null-pointer-constant"
     CONDITION_VARIABLE cvariable_ = CONDITION_VARIABLE_INIT;
 #pragma GCC diagnostic pop
+#if (WINVER >= _WIN32_WINNT_WIN8) && !defined(MINGW_STDTHREADS_ADAPTIVE_MUTEX)
+//    The default mutex, windows8::mutex, cannot be slept on by the native
+//  condition variable functions. Waits here take the SRW-based mutex instead.
+    using mutex = windows7::mutex;
+#endif
 
     friend class condition_variable_any;
 
-#if STDMUTEX_RECURSION_CHECKS
+//    The native wait functions release and reacquire the mutex without calling
+//  its member functions, so do its bookkeeping here. The reacquisition may
+//  block while the thread holds other locks, so it is announced before the
+//  thread goes to sleep, as a blocking lock would announce it.
     template<typename MTX>
     inline static void before_wait (MTX * pmutex)
     {
+#if STDMUTEX_RECURSION_CHECKS
         pmutex->mOwnerThread.checkSetOwnerBeforeUnlock();
+#endif
+        detail::lock_released(pmutex);
+        detail::lock_acquiring(pmutex);
     }
     template<typename MTX>
     inline static void after_wait (MTX * pmutex)
     {
+        detail::lock_acquired(pmutex);
+#if STDMUTEX_RECURSION_CHECKS
         pmutex->mOwnerThread.setOwnerAfterLock(GetCurrentThreadId());
-    }
-#else
-    inline static void before_wait (void *) { }
-    inline static void after_wait (void *) { }
 #endif
+    }
 
-    bool wait_impl (unique_lock<xp::mutex> & lock, DWORD time)
+    bool wait_unique (xp::mutex * pmutex, DWORD time)
     {
         using mutex_handle_type = typename xp::mutex::native_handle_type;
         static_assert(std::is_same<mutex_handle_type, PCRITICAL_SECTION>::value,
                       "Native Win32 condition variable requires std::mutex to \
 use native Win32 critical section objects.");
-        xp::mutex * pmutex = lock.release();
         before_wait(pmutex);
-        BOOL success = SleepConditionVariableCS(&cvariable_,
+        BOOL success = detail::profiled_wait(this, [this, pmutex, time] {
+                return SleepConditionVariableCS(&cvariable_,
                                                 pmutex->native_handle(),
                                                 time);
+            });
         after_wait(pmutex);
-        lock = unique_lock<xp::mutex>(*pmutex, adopt_lock);
         return success;
     }
+    bool wait_impl (unique_lock<xp::mutex> & lock, DWORD time)
+    {
+        return wait_unique(lock.mutex(), time);
+    }
+
+//    The native wait functions release a recursive lock only once, so a thread
+//  that had entered it several times would sleep while holding it. Release it
+//  down to a single level first, and restore the depth after the wait.
+    bool wait_unique (xp::recursive_mutex * pmutex, DWORD time)
+    {
+        PCRITICAL_SECTION handle = pmutex->native_handle();
+        LONG depth = handle->RecursionCount;
+        for (LONG i = 1; i < depth; ++i)
+            LeaveCriticalSection(handle);
+        detail::lock_released(pmutex);
+        detail::lock_acquiring(pmutex);
+        BOOL success = detail::profiled_wait(this, [this, handle, time] {
+                return SleepConditionVariableCS(&cvariable_, handle, time);
+            });
+        detail::lock_acquired(pmutex);
+        for (LONG i = 1; i < depth; ++i)
+            EnterCriticalSection(handle);
+        return success;
+    }
+#if (WINVER >= _WIN32_WINNT_WIN7)
+    bool wait_unique (windows7::recursive_mutex * pmutex, DWORD time)
+    {
+        DWORD owner = pmutex->mOwnerThread.load(std::memory_order_relaxed);
+        DWORD depth = pmutex->mRecursionCount;
+        pmutex->mOwnerThread.store(0, std::memory_order_relaxed);
+        detail::lock_released(pmutex);
+        detail::lock_acquiring(pmutex);
+        BOOL success = detail::profiled_wait(this, [this, pmutex, time] {
+                return SleepConditionVariableSRW(native_handle(),
+                                                 pmutex->native_handle(), time,
+                                                 !CONDITION_VARIABLE_LOCKMODE_SHARED);
+            });
+        detail::lock_acquired(pmutex);
+        pmutex->mOwnerThread.store(owner, std::memory_order_relaxed);
+        pmutex->mRecursionCount = depth;
+        return success;
+    }
+#endif
 
     bool wait_unique (windows7::mutex * pmutex, DWORD time)
     {
         before_wait(pmutex);
-        BOOL success = SleepConditionVariableSRW( native_handle(),
+        BOOL success = detail::profiled_wait(this, [this, pmutex, time] {
+                return SleepConditionVariableSRW( native_handle(),
                                                   pmutex->native_handle(),
                                                   time,
 //    CONDITION_VARIABLE_LOCKMODE_SHARED has a value not specified by
@@ -324,16 +463,27 @@ use native Win32 critical section objects.");
 //  constant, we can either use a static_assert, or simply generate an
 //  appropriate value.
                                            !CONDITION_VARIABLE_LOCKMODE_SHARED);
+            });
         after_wait(pmutex);
         return success;
     }
     bool wait_impl (unique_lock<windows7::mutex> & lock, DWORD time)
     {
-        windows7::mutex * pmutex = lock.release();
-        bool success = wait_unique(pmutex, time);
-        lock = unique_lock<windows7::mutex>(*pmutex, adopt_lock);
+        return wait_unique(lock.mutex(), time);
+    }
+#if (WINVER >= _WIN32_WINNT_WIN7)
+    bool wait_unique (windows7::adaptive_mutex * pmutex, DWORD time)
+    {
+        pmutex->set_held(false);
+        bool success = wait_unique(&pmutex->mBase, time);
+        pmutex->set_held(true);
         return success;
     }
+    bool wait_impl (unique_lock<windows7::adaptive_mutex> & lock, DWORD time)
+    {
+        return wait_unique(lock.mutex(), time);
+    }
+#endif
 public:
     using native_handle_type = PCONDITION_VARIABLE;
     native_handle_type native_handle (void)
@@ -373,11 +523,7 @@ public:
     cv_status wait_for(unique_lock<mutex>& lock,
                        const std::chrono::duration<Rep, Period>& rel_time)
     {
-        using namespace std::chrono;
-        auto timeout = duration_cast<milliseconds>(rel_time).count();
-        DWORD waittime = (timeout < kInfinite) ? ((timeout < 0) ? 0 : static_cast<DWORD>(timeout)) : (kInfinite - 1);
-        bool result = wait_impl(lock, waittime) || (timeout >= kInfinite);
-        return result ? cv_status::no_timeout : cv_status::timeout;
+        return wait_until(lock, detail::deadline_after(rel_time));
     }
 
     template <class Rep, class Period, class Predicate>
@@ -385,15 +531,19 @@ public:
                   const std::chrono::duration<Rep, Period>& rel_time,
                   Predicate pred)
     {
-        return wait_until(lock,
-                          std::chrono::steady_clock::now() + rel_time,
+        return wait_until(lock, detail::deadline_after(rel_time),
                           std::move(pred));
     }
     template <class Clock, class Duration>
     cv_status wait_until (unique_lock<mutex>& lock,
                           const std::chrono::time_point<Clock,Duration>& abs_time)
     {
-        return wait_for(lock, abs_time - Clock::now());
+        return detail::wait_until_deadline(abs_time,
+            [this, &lock] (DWORD time) { return wait_impl(lock, time); },
+            [this, &lock] (std::chrono::steady_clock::time_point deadline) {
+                detail::sleep_unlocked(this, lock, deadline);
+                return false;
+            });
     }
     template <class Clock, class Duration, class Predicate>
     bool wait_until  (unique_lock<mutex>& lock,
@@ -428,32 +578,84 @@ class condition_variable_any
         unique_lock<decltype(internal_mutex_)> internal_lock(internal_mutex_);
         lock.unlock();
         bool success = internal_cv_.wait_impl(internal_lock, time);
+//    Release internal_mutex_ before reacquiring the user's lock. Another waiter
+//  acquires them in the opposite order, so holding both could deadlock.
+        internal_lock.unlock();
         lock.lock();
         return success;
     }
-//    If the lock happens to be called on a native Windows mutex, skip any extra
-//  contention.
-    inline bool wait_impl (unique_lock<mutex> & lock, DWORD time)
+//    If the lock is, or holds, a mutex that the native wait functions can
+//  release and reacquire, sleep on the mutex directly, which skips any extra
+//  contention. The mutex stays owned by `lock` throughout.
+    template<class M>
+    bool wait_native (M * pmutex, DWORD time)
+    {
+        return internal_cv_.wait_unique(pmutex, time);
+    }
+    bool wait_impl (unique_lock<xp::mutex> & lock, DWORD time)
+    {
+        return wait_native(lock.mutex(), time);
+    }
+    bool wait_impl (xp::mutex & lock, DWORD time)
+    {
+        return wait_native(&lock, time);
+    }
+    bool wait_impl (unique_lock<windows7::mutex> & lock, DWORD time)
+    {
+        return wait_native(lock.mutex(), time);
+    }
+    bool wait_impl (windows7::mutex & lock, DWORD time)
+    {
+        return wait_native(&lock, time);
+    }
+#if (WINVER >= _WIN32_WINNT_WIN7)
+    bool wait_impl (unique_lock<windows7::adaptive_mutex> & lock, DWORD time)
+    {
+        return wait_native(lock.mutex(), time);
+    }
+    bool wait_impl (windows7::adaptive_mutex & lock, DWORD time)
     {
-        return internal_cv_.wait_impl(lock, time);
+        return wait_native(&lock, time);
+    }
+    bool wait_impl (unique_lock<windows7::recursive_mutex> & lock, DWORD time)
+    {
+        return wait_native(lock.mutex(), time);
+    }
+    bool wait_impl (windows7::recursive_mutex & lock, DWORD time)
+    {
+        return wait_native(&lock, time);
+    }
+#endif
+    bool wait_impl (unique_lock<xp::recursive_mutex> & lock, DWORD time)
+    {
+        return wait_native(lock.mutex(), time);
+    }
+    bool wait_impl (xp::recursive_mutex & lock, DWORD time)
+    {
+        return wait_native(&lock, time);
     }
 //    Some shared_mutex functionality is available even in Vista, but it's not
 //  until Windows 7 that a full implementation is natively possible. The class
 //  itself is defined, with missing features, at the Vista feature level.
     bool wait_impl (unique_lock<native_shared_mutex> & lock, DWORD time)
     {
-        native_shared_mutex * pmutex = lock.release();
-        bool success = internal_cv_.wait_unique(pmutex, time);
-        lock = unique_lock<native_shared_mutex>(*pmutex, adopt_lock);
-        return success;
+        return wait_native(static_cast<windows7::mutex *>(lock.mutex()), time);
+    }
+    bool wait_impl (native_shared_mutex & lock, DWORD time)
+    {
+        return wait_native(static_cast<windows7::mutex *>(&lock), time);
     }
     bool wait_impl (shared_lock<native_shared_mutex> & lock, DWORD time)
     {
-        native_shared_mutex * pmutex = lock.release();
-        BOOL success = SleepConditionVariableSRW(native_handle(),
+        native_shared_mutex * pmutex = lock.mutex();
+        detail::lock_released(pmutex);
+        detail::lock_acquiring(pmutex);
+        BOOL success = detail::profiled_wait(&internal_cv_, [this, pmutex, time] {
+                return SleepConditionVariableSRW(native_handle(),
                        pmutex->native_handle(), time,
                        CONDITION_VARIABLE_LOCKMODE_SHARED);
-        lock = shared_lock<native_shared_mutex>(*pmutex, adopt_lock);
+            });
+        detail::lock_acquired(pmutex);
         return success;
     }
 public:
@@ -493,25 +695,26 @@ public:
     template <class L, class Rep, class Period>
     cv_status wait_for(L& lock, const std::chrono::duration<Rep,Period>& period)
     {
-        using namespace std::chrono;
-        auto timeout = duration_cast<milliseconds>(period).count();
-        DWORD waittime = (timeout < kInfinite) ? ((timeout < 0) ? 0 : static_cast<DWORD>(timeout)) : (kInfinite - 1);
-        bool result = wait_impl(lock, waittime) || (timeout >= kInfinite);
-        return result ? cv_status::no_timeout : cv_status::timeout;
+        return wait_until(lock, detail::deadline_after(period));
     }
 
     template <class L, class Rep, class Period, class Predicate>
     bool wait_for(L& lock, const std::chrono::duration<Rep, Period>& period,
                   Predicate pred)
     {
-        return wait_until(lock, std::chrono::steady_clock::now() + period,
+        return wait_until(lock, detail::deadline_after(period),
                           std::move(pred));
     }
     template <class L, class Clock, class Duration>
     cv_status wait_until (L& lock,
                           const std::chrono::time_point<Clock,Duration>& abs_time)
     {
-        return wait_for(lock, abs_time - Clock::now());
+        return detail::wait_until_deadline(abs_time,
+            [this, &lock] (DWORD time) { return wait_impl(lock, time); },
+            [this, &lock] (std::chrono::steady_clock::time_point deadline) {
+                detail::sleep_unlocked(this, lock, deadline);
+                return false;
+            });
     }
     template <class L, class Clock, class Duration, class Predicate>
     bool wait_until  (L& lock,
@@ -530,9 +733,26 @@ public:
 };
 } //  Namespace vista
 #endif
+#if (WINVER >= _WIN32_WINNT_WIN8)
+namespace windows8
+{
+//    Both classes sleep on a sequence number with WaitOnAddress. Unlike the
+//  native condition variable, they can release any lock, so the default mutex,
+//  windows8::mutex, can be waited on directly, and condition_variable_any needs
+//  no internal mutex of its own.
+using condition_variable_any = detail::sequence_condition_variable_any;
+using condition_variable = detail::sequence_condition_variable;
+} //  Namespace windows8
+#endif
 #if WINVER < 0x0600
 using xp::condition_variable;
 using xp::condition_variable_any;
+#elif (WINVER >= _WIN32_WINNT_WIN8) && !defined(MINGW_STDTHREADS_ADAPTIVE_MUTEX)
+using windows8::condition_variable;
+using windows8::condition_variable_any;
+#elif (WINVER >= _WIN32_WINNT_WIN8)
+using vista::condition_variable;
+using windows8::condition_variable_any;
 #else
 using vista::condition_variable;
 using vista::condition_variable_any;
@@ -23,16 +23,19 @@
 
 #include <cassert>
 #include <vector>
-#include <utility>        //  For std::pair
+#include <utility>        //  For std::move, std::forward
+#include <functional>     //  For std::function
 #include <type_traits>
 #include <memory>
-#include <functional>     //  For std::hash
+#include <tuple>          //  For PoolTask
 
 #include "mingw.thread.h" //  Start new threads, and use invoke.
 
 //  Mutexes and condition variables are used explicitly.
 #include "mingw.mutex.h"
 #include "mingw.condition_variable.h"
+//  Futures share their mutexes and condition variables through a lock table.
+#include "mingw.lock_table.h"
 
 #if (defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
 #pragma message "The Windows API that MinGW-w32 provides is not fully compatible\
@@ -58,6 +61,10 @@ using std::future_status;
 using std::launch;
 using std::future_category;
 
+//    An extension of std::launch: run the function on the async pool, which is
+//  described below.
+constexpr launch launch_pooled = static_cast<launch>(0x10);
+
 namespace detail
 {
 struct Empty { };
@@ -78,21 +85,197 @@ struct FutureStatic
     kNoWaitMask = 0x14    //  Indicates that waits should immediately exit.
   };
 
-  static std::vector<std::pair<mutex, condition_variable> > sync_pool;
+  static lock_table<0, mutex, condition_variable> sync_pool;
 
   static mutex & get_mutex (void const * ptr)
   {
-    std::hash<void const *> hash_func;
-    return sync_pool[hash_func(ptr) % sync_pool.size()].first;
+    return sync_pool.mutex_for(ptr);
   }
   static condition_variable & get_condition_variable (void const * ptr)
   {
-    std::hash<void const *> hash_func;
-    return sync_pool[hash_func(ptr) % sync_pool.size()].second;
+    return sync_pool.condition_variable_for(ptr);
+  }
+};
+template<bool b>
+lock_table<0, mutex, condition_variable> FutureStatic<b>::sync_pool (thread::hardware_concurrency() * 2 + 1);
+
+//    std::async starts a new thread for every call with launch::async, and
+//  detaches it. Starting and ending a thread costs far more than most such
+//  calls, and a burst of calls starts a burst of threads. Calls with
+//  launch_pooled (or, if MINGW_STDTHREADS_ASYNC_POOL is defined, with
+//  launch::async) instead queue their task for a pool of workers. Workers are
+//  started as tasks arrive, up to one per hardware thread, and then wait for
+//  more tasks instead of exiting.
+//    A task that waits for a future keeps its worker, and if every worker
+//  waited for a task still in the queue, none would finish. A worker blocked in
+//  future::wait or wait_for is therefore not counted against the limit, and
+//  another worker is started if tasks are waiting. Surplus workers exit when
+//  they finish a task. Blocking on anything other than a future is not noticed.
+//    Pooled tasks share threads. A task sees thread_local variables as earlier
+//  tasks on its worker left them, and their destructors run when the worker
+//  exits, rather than before the future becomes ready. Tasks that need fresh
+//  thread_local variables should start a thread of their own.
+struct AsyncTask
+{
+  AsyncTask * mNext;
+
+  AsyncTask (void) noexcept
+    : mNext(nullptr)
+  {
+  }
+  virtual void run (void) = 0;
+  virtual ~AsyncTask (void) = default;
+};
+
+//  Stores the function and its arguments the same way as a new thread would.
+template<class Call>
+struct AsyncCallTask : AsyncTask
+{
+  Call mCall;
+
+  template<class ... Args>
+  explicit AsyncCallTask (Args&&... args)
+    : mCall(std::forward<Args>(args)...)
+  {
+  }
+  void run (void) override
+  {
+    mCall.callFunc();
+  }
+};
+
+template<bool>
+class AsyncPoolStatic
+{
+  mutex mMutex;
+  condition_variable mCondition;
+  AsyncTask * mHead;
+  AsyncTask * mTail;
+  unsigned mQueued;   //  Tasks in the queue.
+  unsigned mWorkers;  //  Workers started, and not yet exited.
+  unsigned mIdle;     //  Workers waiting for a task.
+  unsigned mBlocked;  //  Workers waiting for a future.
+  unsigned const mLimit;
+  static thread_local bool tOnWorker;
+
+  AsyncPoolStatic (unsigned limit)
+    : mMutex(), mCondition(), mHead(nullptr), mTail(nullptr), mQueued(0),
+      mWorkers(0), mIdle(0), mBlocked(0), mLimit((limit != 0) ? limit : 1)
+  {
+  }
+
+  unsigned running (void) const noexcept
+  {
+    return mWorkers - mBlocked;
+  }
+//  Starts a worker if a queued task would otherwise wait. Requires the lock.
+  void add_worker_if_needed (void)
+  {
+    if ((mQueued > mIdle) && (running() < mLimit))
+    {
+      thread([this](void) { work(); }).detach();
+      ++mWorkers;
+    }
+  }
+  void work (void)
+  {
+    tOnWorker = true;
+    std::unique_lock<mutex> lock { mMutex };
+    for (;;)
+    {
+      ++mIdle;
+      mCondition.wait(lock, [this](void)->bool { return mHead != nullptr; });
+      --mIdle;
+      std::unique_ptr<AsyncTask> task { mHead };
+      mHead = task->mNext;
+      if (mHead == nullptr)
+        mTail = nullptr;
+      --mQueued;
+      lock.unlock();
+      task->run();
+      task.reset();
+      lock.lock();
+      if (running() > mLimit)
+      {
+        --mWorkers;
+        return;
+      }
+    }
+  }
+public:
+  AsyncPoolStatic (AsyncPoolStatic const &) = delete;
+  AsyncPoolStatic & operator= (AsyncPoolStatic const &) = delete;
+
+//    The pool is never destroyed, since its workers are detached, and may still
+//  be waiting for tasks when static objects are destroyed.
+  static AsyncPoolStatic & instance (void)
+  {
+    static AsyncPoolStatic * pool = new AsyncPoolStatic(thread::hardware_concurrency());
+    return *pool;
+  }
+
+  template<class Func, class ... Args>
+  void submit (Func && func, Args&&... args)
+  {
+    typedef typename GenIntSeq<sizeof...(Args)>::type ArgSequence;
+    typedef AsyncCallTask<ThreadFuncCall<Func, ArgSequence, Args...> > Task;
+    std::unique_ptr<AsyncTask> task { new Task(std::forward<Func>(func), std::forward<Args>(args)...) };
+    bool wake;
+    {
+      std::lock_guard<mutex> lock { mMutex };
+      ++mQueued;
+//  If no worker could be started, the task runs once one is free.
+      try {
+        add_worker_if_needed();
+      } catch (...) {
+        if (running() == 0)
+        {
+          --mQueued;
+          throw;
+        }
+      }
+      AsyncTask * raw = task.release();
+      if (mTail != nullptr)
+        mTail->mNext = raw;
+      else
+        mHead = raw;
+      mTail = raw;
+      wake = (mIdle != 0);
+    }
+    if (wake)
+      mCondition.notify_one();
   }
+
+//  Marks a pooled task as blocked for the lifetime of this object.
+  class blocking_region
+  {
+    AsyncPoolStatic * mPool;
+  public:
+    blocking_region (void)
+      : mPool(tOnWorker ? &instance() : nullptr)
+    {
+      if (mPool == nullptr)
+        return;
+      std::lock_guard<mutex> lock { mPool->mMutex };
+      ++mPool->mBlocked;
+      try {
+        mPool->add_worker_if_needed();
+      } catch (...) {
+      }
+    }
+    ~blocking_region (void)
+    {
+      if (mPool == nullptr)
+        return;
+      std::lock_guard<mutex> lock { mPool->mMutex };
+      --mPool->mBlocked;
+    }
+    blocking_region (blocking_region const &) = delete;
+    blocking_region & operator= (blocking_region const &) = delete;
+  };
 };
 template<bool b>
-std::vector<std::pair<mutex, condition_variable> > FutureStatic<b>::sync_pool (thread::hardware_concurrency() * 2 + 1);
+thread_local bool AsyncPoolStatic<b>::tOnWorker = false;
 
 struct FutureStateBase
 {
@@ -190,6 +373,7 @@ struct FutureBase : public FutureStatic<true>
 //  synchronization. The `get()` method will do that for us.
     if (mState->mType.load(std::memory_order_relaxed) & Type::kNoWaitMask)
       return;
+    AsyncPoolStatic<true>::blocking_region blocking;
     get_condition_variable().wait(lock, [this](void)->bool {
       return mState->mType.load(std::memory_order_relaxed) & Type::kNoWaitMask;
     });
@@ -206,6 +390,7 @@ struct FutureBase : public FutureStatic<true>
     if (current_state & Type::kNoWaitMask)
       return (current_state & Type::kDeferredFlag) ? future_status::deferred : future_status::ready;
     std::unique_lock<mutex> lock { get_mutex() };
+    AsyncPoolStatic<true>::blocking_region blocking;
     if (get_condition_variable().wait_for(lock, dur,
           [this](void)->bool {
             return mState->mType.load(std::memory_order_relaxed) & Type::kNoWaitMask;
@@ -1074,18 +1259,29 @@ std::future<__async_result_of<Function, Args...> >
     state_ptr = new state_type (std::function<result_type(void)>(std::bind(std::forward<Function>(f), std::forward<Args>(args)...)));*/
 
 
-  if ((policy & std::launch::async) == std::launch::async)
+  bool const pooled = ((policy & mingw_stdthread::launch_pooled) == mingw_stdthread::launch_pooled)
+#if defined(MINGW_STDTHREADS_ASYNC_POOL)
+                   || ((policy & std::launch::async) == std::launch::async)
+#endif
+                   ;
+  if (pooled || ((policy & std::launch::async) == std::launch::async))
   {
     auto deleter = [](state_type * ptr) { ptr->decrement_references(); };
     state_ptr = new state_type ();
     state_ptr->increment_references();
     std::unique_ptr<state_type, decltype(deleter)> ooptr { state_ptr, deleter };
-    mingw_stdthread::thread t ([](decltype(ooptr) ptr, typename std::decay<Function>::type f2, typename std::decay<Args>::type... args2)
+    auto call = [](decltype(ooptr) ptr, typename std::decay<Function>::type f2, typename std::decay<Args>::type... args2)
       {
         typedef mingw_stdthread::detail::StorageHelper<result_type> s_helper;
         s_helper::store(ptr.get(), f2, args2...);
-      }, std::move(ooptr), std::forward<Function>(f), std::forward<Args>(args)...);
-    t.detach();
+      };
+    if (pooled)
+      mingw_stdthread::detail::AsyncPoolStatic<true>::instance().submit(call, std::move(ooptr), std::forward<Function>(f), std::forward<Args>(args)...);
+    else
+    {
+      mingw_stdthread::thread t (call, std::move(ooptr), std::forward<Function>(f), std::forward<Args>(args)...);
+      t.detach();
+    }
   } else {
     typedef std::function<result_type(void)> func_type;
     struct Packed
@@ -1130,4 +1326,53 @@ struct std::uses_allocator<mingw_stdthread::promise<T>, Alloc> : ::std::true_typ
 {
 };
 
+namespace mingw_stdthread
+{
+namespace detail
+{
+//    Runs a function with its arguments, which are stored the same way as for
+//  a new thread, and passes the result or exception to a promise. Used by
+//  thread_pool and io_executor.
+template<class Result, class Func, class Indices, class ... Args>
+class PoolTask;
+
+template<class Result, class Func, std::size_t ... S, class ... Args>
+class PoolTask<Result, Func, IntSeq<S...>, Args...> : public AsyncTask
+{
+  typename std::decay<Func>::type mFunc;
+  std::tuple<typename std::decay<Args>::type...> mArgs;
+  promise<Result> mPromise;
+
+  template<class R>
+  void fulfil (R *)
+  {
+    mPromise.set_value(invoke(std::move(mFunc), std::move(std::get<S>(mArgs))...));
+  }
+  void fulfil (void *)
+  {
+    invoke(std::move(mFunc), std::move(std::get<S>(mArgs))...);
+    mPromise.set_value();
+  }
+public:
+  PoolTask (Func && func, Args&&... args)
+    : mFunc(std::forward<Func>(func)), mArgs(std::forward<Args>(args)...),
+      mPromise()
+  {
+  }
+  future<Result> get_future (void)
+  {
+    return mPromise.get_future();
+  }
+  void run (void) override
+  {
+    try {
+      fulfil(static_cast<typename std::remove_reference<Result>::type *>(nullptr));
+    } catch (...) {
+      mPromise.set_exception(std::current_exception());
+    }
+  }
+};
+} //  Namespace "detail"
+} //  Namespace "mingw_stdthread"
+
 #endif // MINGW_FUTURE_H_
@@ -0,0 +1,225 @@
+/// \file mingw.io_executor.h
+/// \brief Overlapped I/O and tasks, completed by threads waiting on an I/O
+///   completion port.
+///
+/// (c) 2013-2016 by Mega Limited, Auckland, New Zealand
+///
+/// \copyright Simplified (2-clause) BSD License.
+///
+/// \note This file may become part of the mingw-w64 runtime package. If/when
+/// this happens, the appropriate license will be added, i.e. this code will
+/// become dual-licensed, and the current BSD 2-clause license will stay.
+
+//    When an overlapped read or write on a handle that is associated with an
+//  I/O completion port finishes, Windows queues a packet on the port. The
+//  executor's threads wait on the port, and fulfil the future of each finished
+//  operation directly, without passing the result through another thread.
+//  Tasks are queued on the same port with PostQueuedCompletionStatus, so one
+//  set of threads serves both.
+//    Reads return 0 bytes at the end of a file, and once the other end of a
+//  pipe has been closed. Other errors are passed to the future as a
+//  std::system_error. Operations that fail immediately fulfil their future
+//  before read or write returns.
+//    Every operation must have finished before the executor is destroyed.
+//  Closing a handle cancels the operations still pending on it.
+
+#ifndef MINGW_IO_EXECUTOR_H_
+#define MINGW_IO_EXECUTOR_H_
+
+#if !defined(__cplusplus) || (__cplusplus < 201103L)
+#error A C++11 compiler is required!
+#endif
+
+#include <cstddef>          //  For std::size_t
+#include <cstdint>          //  For std::uint64_t
+#include <memory>           //  For std::unique_ptr
+#include <system_error>
+#include <type_traits>
+#include <utility>          //  For std::declval, std::forward
+#include <vector>
+
+#include <sdkddkver.h>  //  Detect Windows version.
+#if (defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
+#include <windows.h>    //  No further granularity can be expected.
+#else
+#include <fileapi.h>        //  For ReadFile, WriteFile
+#include <ioapiset.h>       //  For the I/O completion port functions
+#include <handleapi.h>      //  For CloseHandle
+#include <errhandlingapi.h> //  For GetLastError
+#endif
+
+#include "mingw.thread.h"
+//  For future, and for PoolTask, which runs a task and fulfils its promise.
+#include "mingw.future.h"
+
+namespace mingw_stdthread
+{
+namespace detail
+{
+//    One overlapped read or write. Windows writes into the OVERLAPPED until
+//  the operation's packet is dequeued, so the operation lives on the heap, and
+//  is deleted by the thread that completes it.
+struct IoOperation : OVERLAPPED
+{
+    static constexpr DWORD kErrorHandleEof = 38;
+    static constexpr DWORD kErrorBrokenPipe = 109;
+
+    promise<std::size_t> mPromise;
+    bool mRead;
+
+    IoOperation (bool read, std::uint64_t offset)
+        : OVERLAPPED(), mPromise(), mRead(read)
+    {
+        Offset = static_cast<DWORD>(offset);
+        OffsetHigh = static_cast<DWORD>(offset >> 32);
+    }
+    void complete (DWORD bytes, DWORD error)
+    {
+        if ((error == 0) || (mRead && ((error == kErrorHandleEof) || (error == kErrorBrokenPipe))))
+            mPromise.set_value(bytes);
+        else
+            mPromise.set_exception(std::make_exception_ptr(
+                std::system_error(static_cast<int>(error), std::system_category())));
+    }
+};
+} //  Namespace "detail"
+
+class io_executor
+{
+    static constexpr DWORD kInfinite = 0xffffffffl;
+    static constexpr DWORD kErrorIoPending = 997;
+//  Handles are associated with key 0. A packet with key 0 and no OVERLAPPED
+//  stops a thread; any other key without an OVERLAPPED is a task.
+    static constexpr ULONG_PTR kStopKey = 0;
+
+    HANDLE mPort;
+    std::vector<thread> mThreads;
+
+    void complete (void)
+    {
+        for (;;)
+        {
+            DWORD bytes = 0;
+            ULONG_PTR key = 0;
+            OVERLAPPED * overlapped = nullptr;
+            BOOL success = GetQueuedCompletionStatus(mPort, &bytes, &key, &overlapped, kInfinite);
+            if (overlapped != nullptr)
+            {
+                std::unique_ptr<detail::IoOperation> operation (static_cast<detail::IoOperation *>(overlapped));
+                operation->complete(bytes, success ? 0 : GetLastError());
+            }
+            else if (!success || (key == kStopKey))
+                return;
+            else
+            {
+                std::unique_ptr<detail::AsyncTask> task (reinterpret_cast<detail::AsyncTask *>(key));
+                task->run();
+            }
+        }
+    }
+//  Takes ownership of the operation if it is pending, and otherwise completes it.
+    static void start (std::unique_ptr<detail::IoOperation> & operation, BOOL success)
+    {
+        DWORD error = success ? 0 : GetLastError();
+        if (success || (error == kErrorIoPending))
+            operation.release();
+        else
+            operation->complete(0, error);
+    }
+    static DWORD clamp (std::size_t size) noexcept
+    {
+        return (size < kInfinite) ? static_cast<DWORD>(size) : kInfinite;
+    }
+    void stop (void) noexcept
+    {
+        for (thread & t : mThreads)
+            if (t.joinable())
+                PostQueuedCompletionStatus(mPort, 0, kStopKey, nullptr);
+        for (thread & t : mThreads)
+            if (t.joinable())
+                t.join();
+        CloseHandle(mPort);
+    }
+public:
+    typedef HANDLE native_handle_type;
+
+//  Starts `num_threads` threads (at least one) to wait on a new port.
+    explicit io_executor (unsigned num_threads = thread::hardware_concurrency())
+        : mPort(nullptr), mThreads()
+    {
+        if (num_threads == 0)
+            num_threads = 1;
+        mPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, num_threads);
+        if (mPort == nullptr)
+            throw std::system_error(GetLastError(), std::system_category());
+        try {
+            for (unsigned i = 0; i < num_threads; ++i)
+                mThreads.push_back(thread([this] (void) { complete(); }));
+        } catch (...) {
+            stop();
+            throw;
+        }
+    }
+//  Runs the tasks already posted, then stops the threads.
+    ~io_executor (void)
+    {
+        stop();
+    }
+    io_executor (const io_executor&) = delete;
+    io_executor & operator= (const io_executor&) = delete;
+
+    native_handle_type native_handle (void) const noexcept
+    {
+        return mPort;
+    }
+
+//    Routes the completions of `handle` to this executor. The handle must
+//  have been opened for overlapped I/O (FILE_FLAG_OVERLAPPED), and can be
+//  associated with only one port.
+    void associate (HANDLE handle)
+    {
+        if (CreateIoCompletionPort(handle, mPort, 0, 0) != mPort)
+            throw std::system_error(GetLastError(), std::system_category());
+    }
+
+//    Reads up to `size` bytes (at most 4 GiB - 1) at `offset`, which is
+//  ignored by pipes and sockets. `buffer` must remain valid until the future
+//  is ready.
+    future<std::size_t> read (HANDLE handle, void * buffer, std::size_t size,
+                              std::uint64_t offset = 0)
+    {
+        std::unique_ptr<detail::IoOperation> operation (new detail::IoOperation(true, offset));
+        future<std::size_t> result = operation->mPromise.get_future();
+        start(operation, ReadFile(handle, buffer, clamp(size), nullptr, operation.get()));
+        return result;
+    }
+    future<std::size_t> write (HANDLE handle, void const * buffer, std::size_t size,
+                               std::uint64_t offset = 0)
+    {
+        std::unique_ptr<detail::IoOperation> operation (new detail::IoOperation(false, offset));
+        future<std::size_t> result = operation->mPromise.get_future();
+        start(operation, WriteFile(handle, buffer, clamp(size), nullptr, operation.get()));
+        return result;
+    }
+
+//  Queues invoke(func, args...) on the port, and returns a future for its result.
+    template<class Func, class ... Args>
+    future<decltype(detail::invoke(std::declval<typename std::decay<Func>::type>(),
+                                   std::declval<typename std::decay<Args>::type>()...))>
+        post (Func && func, Args&&... args)
+    {
+        typedef decltype(detail::invoke(std::declval<typename std::decay<Func>::type>(),
+                                        std::declval<typename std::decay<Args>::type>()...)) Result;
+        typedef typename detail::GenIntSeq<sizeof...(Args)>::type Indices;
+        typedef detail::PoolTask<Result, Func, Indices, Args...> Task;
+        std::unique_ptr<Task> task (new Task(std::forward<Func>(func), std::forward<Args>(args)...));
+        future<Result> result = task->get_future();
+        detail::AsyncTask * base = task.get();
+        if (!PostQueuedCompletionStatus(mPort, 0, reinterpret_cast<ULONG_PTR>(base), nullptr))
+            throw std::system_error(GetLastError(), std::system_category());
+        task.release();
+        return result;
+    }
+};
+} //  Namespace "mingw_stdthread"
+#endif // MINGW_IO_EXECUTOR_H_
@@ -0,0 +1,922 @@
+/// \file mingw.lock_diagnostics.h
+/// \brief Optional instrumentation of the locks in this library.
+///
+/// (c) 2013-2016 by Mega Limited, Auckland, New Zealand
+///
+/// \copyright Simplified (2-clause) BSD License.
+///
+/// \note This file may become part of the mingw-w64 runtime package. If/when
+/// this happens, the appropriate license will be added, i.e. this code will
+/// become dual-licensed, and the current BSD 2-clause license will stay.
+
+//    Every mutex, shared_mutex and condition variable in this library reports
+//  its acquisitions and releases to the hooks in namespace detail below. Unless
+//  a diagnostic feature is enabled, the hooks are empty and compile away.
+//
+//    MINGW_STDTHREADS_LOCK_STATS enables a contention profiler. For each lock,
+//  it counts acquisitions and contended acquisitions (those which could not be
+//  satisfied immediately), and measures the time spent waiting for the lock and
+//  the time for which it was held. Condition variables count their waits and
+//  the time spent waiting. Each thread accumulates into its own table, so that
+//  the only shared memory touched by the hooks is the lock itself. Locks are
+//  identified by address; lock_stats::set_name attaches a readable name.
+//  Statistics for a lock that is destroyed are merged with those of any lock
+//  later created at the same address.
+//    Notes:
+//  - Re-entry into a recursive mutex by its owner is not counted; the hold time
+//    runs from the outermost lock to the matching unlock.
+//  - When a condition variable waits, the hold time of its mutex is split: the
+//    time spent waiting is not counted as holding.
+//  - On Vista, SRW locks cannot be tried, so an exclusive acquisition counts as
+//    contended only if it took measurable time.
+//
+//    MINGW_STDTHREADS_LOCK_ORDER_CHECKS enables a lock-order checker. Whenever
+//  a thread blocks to acquire a lock while holding others, the checker records
+//  that each held lock was ordered before the new one. If some thread has
+//  already acquired these locks in the opposite order (directly or through
+//  other locks), the orders form a cycle, and two threads following them could
+//  deadlock. The cycle is reported the first time it appears, whether or not
+//  the threads ever actually deadlock. Notes:
+//  - Only acquisitions that can block record an order. try_lock and the timed
+//    functions cannot deadlock, and are free to acquire locks in any order.
+//  - Both modes of a shared_mutex count as the same lock.
+//  - To keep the overhead low enough for production use, only one in every
+//    MINGW_STDTHREADS_LOCK_ORDER_SAMPLE blocking acquisitions (1 by default) is
+//    checked; lock_order::set_sample_rate changes the rate at run time. Each
+//    thread remembers the orders it has already recorded, so an acquisition in
+//    a known order does not touch any shared memory.
+//  - Locks are identified by address. Each lock forgets its orders when it is
+//    destroyed, so that a lock later created in the same memory is not
+//    confused with it.
+
+#ifndef MINGW_LOCK_DIAGNOSTICS_H_
+#define MINGW_LOCK_DIAGNOSTICS_H_
+
+#if !defined(__cplusplus) || (__cplusplus < 201103L)
+#error A C++11 compiler is required!
+#endif
+
+#include <cstdio>       //  For lock_stats::dump
+#include <string>       //  For lock_stats::entry
+#include <vector>       //  For lock_stats::snapshot
+
+#if defined(MINGW_STDTHREADS_LOCK_STATS) || defined(MINGW_STDTHREADS_LOCK_ORDER_CHECKS)
+#include <algorithm>    //  For std::sort, std::find
+#include <atomic>
+#include <cstddef>      //  For std::size_t, std::uintptr_t
+#include <new>          //  For std::nothrow
+#include <unordered_map>
+
+#include <sdkddkver.h>  //  Detect Windows version.
+#if (defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
+#include <windows.h>    //  No further granularity can be expected.
+#else
+#include <profileapi.h> //  For QueryPerformanceCounter
+#include <processthreadsapi.h>  //  For SwitchToThread
+#endif
+#endif
+
+namespace mingw_stdthread
+{
+namespace lock_stats
+{
+//  Statistics for a single lock or condition variable, merged over all threads.
+struct entry
+{
+    void const * lock;
+    std::string name;
+    unsigned long long acquisitions;
+    unsigned long long contentions;
+    double wait_seconds;
+    double hold_seconds;
+};
+} //  Namespace "lock_stats"
+
+namespace lock_order
+{
+//    Called with each lock-order cycle. Each lock in `cycle` was acquired while
+//  holding the one before it, and the first while holding the last.
+typedef void (* handler_type) (std::vector<void const *> const & cycle);
+} //  Namespace "lock_order"
+
+namespace detail
+{
+#if defined(MINGW_STDTHREADS_LOCK_STATS) || defined(MINGW_STDTHREADS_LOCK_ORDER_CHECKS)
+//    State shared by the diagnostic features. Use a class template to allow
+//  instantiation of statics in a header-only library. Every static is zero-
+//  initialized, so that the hooks can be used during static initialization.
+template<bool>
+struct LockRegistryStatic
+{
+    static std::atomic<bool> sBusy;
+    static std::unordered_map<void const *, std::string> * sNames;
+
+//    Protects the diagnostic state. Held only briefly, and never by the hooks
+//  on their fast paths.
+    static void lock_registry (void) noexcept
+    {
+        while (sBusy.exchange(true, std::memory_order_acquire))
+            SwitchToThread();
+    }
+    static void unlock_registry (void) noexcept
+    {
+        sBusy.store(false, std::memory_order_release);
+    }
+};
+template<bool b>
+std::atomic<bool> LockRegistryStatic<b>::sBusy;
+template<bool b>
+std::unordered_map<void const *, std::string> * LockRegistryStatic<b>::sNames;
+#endif
+
+#if defined(MINGW_STDTHREADS_LOCK_STATS)
+template<bool>
+struct LockStatsStatic : LockRegistryStatic<true>
+{
+//    Counters are only written by the thread that owns the table, without any
+//  read-modify-write, but may be read by any thread taking a snapshot.
+    struct Slot
+    {
+        std::atomic<void const *> mLock;
+        std::atomic<unsigned long long> mAcquisitions;
+        std::atomic<unsigned long long> mContentions;
+        std::atomic<unsigned long long> mWaitTicks;
+        std::atomic<unsigned long long> mHoldTicks;
+        void clear (void) noexcept
+        {
+            mAcquisitions.store(0, std::memory_order_relaxed);
+            mContentions.store(0, std::memory_order_relaxed);
+            mWaitTicks.store(0, std::memory_order_relaxed);
+            mHoldTicks.store(0, std::memory_order_relaxed);
+        }
+    };
+    struct Held
+    {
+        void const * mLock;
+        unsigned mDepth;
+        long long mSince;
+    };
+    static constexpr std::size_t kSlots = 256;
+    static constexpr std::size_t kProbes = 16;
+    static constexpr std::size_t kMaxHeld = 16;
+    struct ThreadTable
+    {
+        Slot mSlots [kSlots];
+//  Locks that do not fit into the table are counted together.
+        Slot mOverflow;
+        Held mHeld [kMaxHeld];
+        std::size_t mHeldCount;
+        std::atomic<unsigned> mEpoch;
+        ThreadTable * mNext;
+    };
+    struct Totals
+    {
+        unsigned long long mAcquisitions, mContentions, mWaitTicks, mHoldTicks;
+    };
+
+    static std::atomic<unsigned> sEpoch;
+    static ThreadTable * sThreads;
+    static std::unordered_map<void const *, Totals> * sRetired;
+    static thread_local ThreadTable * tTable;
+    static thread_local bool tExited;
+
+    static long long now (void) noexcept
+    {
+        LARGE_INTEGER ticks;
+        QueryPerformanceCounter(&ticks);
+        return ticks.QuadPart;
+    }
+
+    static void add (std::atomic<unsigned long long> & counter,
+                     unsigned long long amount) noexcept
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + amount,
+                      std::memory_order_relaxed);
+    }
+
+//    When the thread exits, merge its statistics into the retired totals, so
+//  that its table can be freed.
+    struct ThreadReaper
+    {
+        ~ThreadReaper (void)
+        {
+            ThreadTable * table = tTable;
+            tTable = nullptr;
+            tExited = true;
+            if (table == nullptr)
+                return;
+            lock_registry();
+            for (ThreadTable ** link = &sThreads; *link != nullptr; link = &(*link)->mNext)
+                if (*link == table)
+                {
+                    *link = table->mNext;
+                    break;
+                }
+            if (table->mEpoch.load(std::memory_order_relaxed) == sEpoch.load(std::memory_order_relaxed))
+            {
+                if (sRetired == nullptr)
+                    sRetired = new std::unordered_map<void const *, Totals>();
+                for (std::size_t i = 0; i <= kSlots; ++i)
+                {
+                    Slot & slot = (i < kSlots) ? table->mSlots[i] : table->mOverflow;
+                    void const * lock = slot.mLock.load(std::memory_order_relaxed);
+                    if ((lock == nullptr) && (i < kSlots))
+                        continue;
+                    Totals & totals = (*sRetired)[lock];
+                    totals.mAcquisitions += slot.mAcquisitions.load(std::memory_order_relaxed);
+                    totals.mContentions += slot.mContentions.load(std::memory_order_relaxed);
+                    totals.mWaitTicks += slot.mWaitTicks.load(std::memory_order_relaxed);
+                    totals.mHoldTicks += slot.mHoldTicks.load(std::memory_order_relaxed);
+                }
+            }
+            unlock_registry();
+            delete table;
+        }
+    };
+
+//    Returns this thread's table, creating it on first use. Returns nullptr
+//  while the thread is exiting, after its table has been retired.
+    static ThreadTable * this_thread_table (void) noexcept
+    {
+        ThreadTable * table = tTable;
+        if (table == nullptr)
+        {
+            if (tExited)
+                return nullptr;
+            table = new (std::nothrow) ThreadTable();
+            if (table == nullptr)
+                return nullptr;
+            table->mEpoch.store(sEpoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            lock_registry();
+            table->mNext = sThreads;
+            sThreads = table;
+            unlock_registry();
+            tTable = table;
+            static thread_local ThreadReaper reaper;
+            (void)reaper;
+        }
+//  Discard statistics gathered before the last call to lock_stats::reset.
+        unsigned epoch = sEpoch.load(std::memory_order_relaxed);
+        if (table->mEpoch.load(std::memory_order_relaxed) != epoch)
+        {
+            for (Slot & slot : table->mSlots)
+                slot.clear();
+            table->mOverflow.clear();
+            table->mEpoch.store(epoch, std::memory_order_release);
+        }
+        return table;
+    }
+
+    static Slot & find_slot (ThreadTable & table, void const * lock) noexcept
+    {
+        std::uintptr_t bits = reinterpret_cast<std::uintptr_t>(lock) >> 3;
+        for (std::size_t i = 0; i < kProbes; ++i)
+        {
+            Slot & slot = table.mSlots[(bits + i) % kSlots];
+            void const * key = slot.mLock.load(std::memory_order_relaxed);
+            if (key == lock)
+                return slot;
+            if (key == nullptr)
+            {
+                slot.mLock.store(lock, std::memory_order_release);
+                return slot;
+            }
+        }
+        return table.mOverflow;
+    }
+
+    static void acquired (void const * lock, bool contended, long long waited) noexcept
+    {
+        ThreadTable * table = this_thread_table();
+        if (table == nullptr)
+            return;
+//  Re-entry into a recursive lock only deepens the existing hold.
+        for (std::size_t i = table->mHeldCount; i-- > 0;)
+            if (table->mHeld[i].mLock == lock)
+            {
+                ++table->mHeld[i].mDepth;
+                return;
+            }
+        Slot & slot = find_slot(*table, lock);
+        add(slot.mAcquisitions, 1);
+        if (contended)
+        {
+            add(slot.mContentions, 1);
+            add(slot.mWaitTicks, static_cast<unsigned long long>(waited));
+        }
+        if (table->mHeldCount < kMaxHeld)
+            table->mHeld[table->mHeldCount++] = Held { lock, 1, now() };
+    }
+
+    static void released (void const * lock) noexcept
+    {
+        ThreadTable * table = tTable;
+        if (table == nullptr)
+            return;
+        for (std::size_t i = table->mHeldCount; i-- > 0;)
+        {
+            Held & held = table->mHeld[i];
+            if (held.mLock != lock)
+                continue;
+            if (--held.mDepth != 0)
+                return;
+            add(find_slot(*table, lock).mHoldTicks,
+                static_cast<unsigned long long>(now() - held.mSince));
+            for (; i + 1 < table->mHeldCount; ++i)
+                table->mHeld[i] = table->mHeld[i + 1];
+            --table->mHeldCount;
+            return;
+        }
+    }
+
+    static void waited (void const * condition, long long ticks) noexcept
+    {
+        ThreadTable * table = this_thread_table();
+        if (table == nullptr)
+            return;
+        Slot & slot = find_slot(*table, condition);
+        add(slot.mAcquisitions, 1);
+        add(slot.mContentions, 1);
+        add(slot.mWaitTicks, static_cast<unsigned long long>(ticks));
+    }
+};
+template<bool b>
+std::atomic<unsigned> LockStatsStatic<b>::sEpoch;
+template<bool b>
+typename LockStatsStatic<b>::ThreadTable * LockStatsStatic<b>::sThreads;
+template<bool b>
+std::unordered_map<void const *, typename LockStatsStatic<b>::Totals> * LockStatsStatic<b>::sRetired;
+template<bool b>
+thread_local typename LockStatsStatic<b>::ThreadTable * LockStatsStatic<b>::tTable;
+template<bool b>
+thread_local bool LockStatsStatic<b>::tExited;
+#endif
+
+#if defined(MINGW_STDTHREADS_LOCK_ORDER_CHECKS)
+#if !defined(MINGW_STDTHREADS_LOCK_ORDER_SAMPLE)
+#define MINGW_STDTHREADS_LOCK_ORDER_SAMPLE 1
+#endif
+template<bool>
+struct LockOrderStatic : LockRegistryStatic<true>
+{
+    static constexpr std::size_t kMaxHeld = 32;
+    static constexpr std::size_t kCacheSize = 64;
+    struct Held
+    {
+        void const * mLock;
+        unsigned mDepth;
+    };
+    struct Edge
+    {
+        void const * mFrom;
+        void const * mTo;
+    };
+//    Trivially constructible and destructible, so that it can be used at any
+//  point in the life of a thread. Locks beyond kMaxHeld are not tracked.
+    struct ThreadState
+    {
+        Held mHeld [kMaxHeld];
+        std::size_t mHeldCount;
+        unsigned mCountdown;
+        unsigned mGeneration;
+        bool mReporting;
+//  Orders already present in the graph, so that they need not be looked up.
+        Edge mKnown [kCacheSize];
+    };
+    typedef std::unordered_map<void const *, std::vector<void const *> > Graph;
+
+    static std::atomic<unsigned> sSampleRate;
+    static std::atomic<unsigned> sGeneration;
+    static std::atomic<lock_order::handler_type> sHandler;
+    static Graph * sGraph;
+    static thread_local ThreadState tState;
+
+    static Held * find_held (ThreadState & state, void const * lock) noexcept
+    {
+        for (std::size_t i = state.mHeldCount; i-- > 0;)
+            if (state.mHeld[i].mLock == lock)
+                return &state.mHeld[i];
+        return nullptr;
+    }
+
+    static void acquired (void const * lock) noexcept
+    {
+        ThreadState & state = tState;
+        if (Held * held = find_held(state, lock))
+            ++held->mDepth;
+        else if (state.mHeldCount < kMaxHeld)
+            state.mHeld[state.mHeldCount++] = Held { lock, 1 };
+    }
+
+    static void released (void const * lock) noexcept
+    {
+        ThreadState & state = tState;
+        Held * held = find_held(state, lock);
+        if ((held == nullptr) || (--held->mDepth != 0))
+            return;
+        for (Held * end = state.mHeld + --state.mHeldCount; held != end; ++held)
+            held[0] = held[1];
+    }
+
+//    Searches the graph for a chain of orders leading from `from` to `to`.
+//  If there is one, stores the locks along it in `path`, excluding `to`.
+    static bool find_path (void const * from, void const * to,
+                           std::vector<void const *> & path)
+    {
+        std::unordered_map<void const *, void const *> parents;
+        std::vector<void const *> pending (1, from);
+        parents[from] = nullptr;
+        while (!pending.empty())
+        {
+            void const * lock = pending.back();
+            pending.pop_back();
+            auto successors = sGraph->find(lock);
+            if (successors == sGraph->end())
+                continue;
+            for (void const * next : successors->second)
+            {
+                if (!parents.insert(std::make_pair(next, lock)).second)
+                    continue;
+                if (next != to)
+                {
+                    pending.push_back(next);
+                    continue;
+                }
+                for (void const * step = lock; step != nullptr; step = parents[step])
+                    path.push_back(step);
+                std::reverse(path.begin(), path.end());
+                return true;
+            }
+        }
+        return false;
+    }
+
+//    Records that `from` was held while acquiring `to`. Returns the resulting
+//  cycle, if any, starting with `from`. Only the first occurrence of an order
+//  is checked, so each cycle is reported once.
+    static std::vector<void const *> add_order (void const * from, void const * to)
+    {
+        std::vector<void const *> cycle;
+        lock_registry();
+        try {
+            if (sGraph == nullptr)
+                sGraph = new Graph();
+//  Every lock in an order has an entry, so that forget can skip the others.
+            (*sGraph)[to];
+            std::vector<void const *> & successors = (*sGraph)[from];
+            if (std::find(successors.begin(), successors.end(), to) == successors.end())
+            {
+                std::vector<void const *> path;
+                if (find_path(to, from, path))
+                {
+                    cycle.push_back(from);
+                    cycle.insert(cycle.end(), path.begin(), path.end());
+                }
+                successors.push_back(to);
+            }
+        } catch (...) {
+//  Out of memory. Skip this order; it will be checked again later.
+        }
+        unlock_registry();
+        return cycle;
+    }
+
+    static void report (std::vector<void const *> const & cycle);
+
+//    Removes `lock` and its orders from the graph. If it had any, every thread
+//  must also drop the orders it remembers, which may involve `lock`.
+    static void forget (void const * lock) noexcept
+    {
+        lock_registry();
+        if (sGraph != nullptr)
+        {
+            auto entry = sGraph->find(lock);
+            if (entry != sGraph->end())
+            {
+                sGraph->erase(entry);
+                for (auto & item : *sGraph)
+                {
+                    std::vector<void const *> & successors = item.second;
+                    successors.erase(std::remove(successors.begin(), successors.end(), lock),
+                                     successors.end());
+                }
+                sGeneration.fetch_add(1, std::memory_order_release);
+            }
+        }
+        unlock_registry();
+    }
+
+//    Called before blocking to acquire `lock`. The check runs before the
+//  acquisition, so that a cycle is reported even if it does cause a deadlock.
+    static void acquiring (void const * lock)
+    {
+        ThreadState & state = tState;
+        if ((state.mHeldCount == 0) || state.mReporting)
+            return;
+        if (state.mCountdown != 0)
+        {
+            --state.mCountdown;
+            return;
+        }
+        unsigned rate = sSampleRate.load(std::memory_order_relaxed);
+        state.mCountdown = ((rate != 0) ? rate : MINGW_STDTHREADS_LOCK_ORDER_SAMPLE) - 1;
+//  Re-entry into a recursive lock does not order anything.
+        if (find_held(state, lock) != nullptr)
+            return;
+        unsigned generation = sGeneration.load(std::memory_order_acquire);
+        if (state.mGeneration != generation)
+        {
+            for (Edge & edge : state.mKnown)
+                edge = Edge { nullptr, nullptr };
+            state.mGeneration = generation;
+        }
+        for (std::size_t i = 0; i < state.mHeldCount; ++i)
+        {
+            void const * from = state.mHeld[i].mLock;
+            std::uintptr_t bits = reinterpret_cast<std::uintptr_t>(from) ^
+                                  (reinterpret_cast<std::uintptr_t>(lock) >> 4);
+            Edge & known = state.mKnown[(bits >> 3) % kCacheSize];
+            if ((known.mFrom == from) && (known.mTo == lock))
+                continue;
+            std::vector<void const *> cycle = add_order(from, lock);
+            known = Edge { from, lock };
+            if (!cycle.empty())
+            {
+                state.mReporting = true;
+                report(cycle);
+                state.mReporting = false;
+            }
+        }
+    }
+};
+template<bool b>
+std::atomic<unsigned> LockOrderStatic<b>::sSampleRate;
+template<bool b>
+std::atomic<unsigned> LockOrderStatic<b>::sGeneration;
+template<bool b>
+std::atomic<lock_order::handler_type> LockOrderStatic<b>::sHandler;
+template<bool b>
+typename LockOrderStatic<b>::Graph * LockOrderStatic<b>::sGraph;
+template<bool b>
+thread_local typename LockOrderStatic<b>::ThreadState LockOrderStatic<b>::tState;
+
+template<bool b>
+void LockOrderStatic<b>::report (std::vector<void const *> const & cycle)
+{
+    lock_order::handler_type handler = sHandler.load(std::memory_order_acquire);
+    if (handler != nullptr)
+    {
+        handler(cycle);
+        return;
+    }
+    std::string text = "Lock order inversion (potential deadlock):";
+    for (std::size_t i = 0; i <= cycle.size(); ++i)
+    {
+        void const * lock = cycle[i % cycle.size()];
+        char address [32];
+        std::snprintf(address, sizeof(address), "%p", lock);
+        lock_registry();
+        if (sNames != nullptr)
+        {
+            auto name = sNames->find(lock);
+            if (name != sNames->end())
+                std::snprintf(address, sizeof(address), "%.31s", name->second.c_str());
+        }
+        unlock_registry();
+        text += (i == 0) ? " " : " -> ";
+        text += address;
+    }
+    std::fprintf(stderr, "%s\n", text.c_str());
+    std::fflush(stderr);
+}
+#endif
+
+//    Report that the calling thread acquired `lock`. A contended acquisition is
+//  one that could not be satisfied immediately, and `waited` is the time spent
+//  waiting, in performance-counter ticks.
+inline void lock_acquired (void const * lock, bool contended = false,
+                           long long waited = 0) noexcept
+{
+#if defined(MINGW_STDTHREADS_LOCK_ORDER_CHECKS)
+    LockOrderStatic<true>::acquired(lock);
+#endif
+#if defined(MINGW_STDTHREADS_LOCK_STATS)
+    LockStatsStatic<true>::acquired(lock, contended, waited);
+#else
+    (void)lock;
+    (void)contended;
+    (void)waited;
+#endif
+}
+
+//  Report that the calling thread is about to release `lock`.
+inline void lock_released (void const * lock) noexcept
+{
+#if defined(MINGW_STDTHREADS_LOCK_ORDER_CHECKS)
+    LockOrderStatic<true>::released(lock);
+#endif
+#if defined(MINGW_STDTHREADS_LOCK_STATS)
+    LockStatsStatic<true>::released(lock);
+#else
+    (void)lock;
+#endif
+}
+
+//    Report that the calling thread may block until it acquires `lock`. Must be
+//  followed by lock_acquired once it succeeds.
+inline void lock_acquiring (void const * lock)
+{
+#if defined(MINGW_STDTHREADS_LOCK_ORDER_CHECKS)
+    LockOrderStatic<true>::acquiring(lock);
+#else
+    (void)lock;
+#endif
+}
+
+//    Report that `lock` is being destroyed, so that a lock later created at the
+//  same address is not mistaken for it.
+inline void lock_destroyed (void const * lock) noexcept
+{
+#if defined(MINGW_STDTHREADS_LOCK_ORDER_CHECKS)
+    LockOrderStatic<true>::forget(lock);
+#else
+    (void)lock;
+#endif
+}
+
+//    Acquire a lock through `acquire`, and report the acquisition. `acquire`
+//  must not rely on a previous attempt: it takes the lock's usual path, fast
+//  path included. Only the contention profiler calls `try_acquire`, which must
+//  not block, first, to tell contended acquisitions from the others.
+template<class TryAcquire, class Acquire>
+inline void profiled_lock (void const * lock, TryAcquire && try_acquire,
+                           Acquire && acquire)
+{
+    lock_acquiring(lock);
+#if defined(MINGW_STDTHREADS_LOCK_STATS)
+    if (try_acquire())
+    {
+        lock_acquired(lock);
+        return;
+    }
+    using Static = LockStatsStatic<true>;
+    long long start = Static::now();
+    acquire();
+    lock_acquired(lock, true, Static::now() - start);
+#else
+    (void)try_acquire;
+    acquire();
+    lock_acquired(lock);
+#endif
+}
+
+//    As above, for locks whose only fast path is `try_acquire`: `contended`
+//  may only be called once it has failed, and may use what it left behind.
+template<class TryAcquire, class Contended>
+inline void profiled_try_then_lock (void const * lock, TryAcquire && try_acquire,
+                                    Contended && contended)
+{
+#if defined(MINGW_STDTHREADS_LOCK_STATS)
+    profiled_lock(lock, try_acquire, contended);
+#else
+    lock_acquiring(lock);
+    if (!try_acquire())
+        contended();
+    lock_acquired(lock);
+#endif
+}
+
+//    As above, for locks that cannot be tried. The acquisition counts as
+//  contended only if it took measurable time.
+template<class Acquire>
+inline void profiled_lock (void const * lock, Acquire && acquire)
+{
+    lock_acquiring(lock);
+#if defined(MINGW_STDTHREADS_LOCK_STATS)
+    using Static = LockStatsStatic<true>;
+    long long start = Static::now();
+    acquire();
+    long long waited = Static::now() - start;
+    lock_acquired(lock, waited > 0, waited);
+#else
+    acquire();
+    lock_acquired(lock);
+#endif
+}
+
+//    As profiled_lock, but `timed_acquire` may give up, returning false. Only
+//  successful acquisitions are reported.
+template<class TryAcquire, class TimedAcquire>
+inline bool profiled_try_lock (void const * lock, TryAcquire && try_acquire,
+                               TimedAcquire && timed_acquire)
+{
+#if defined(MINGW_STDTHREADS_LOCK_STATS)
+    if (try_acquire())
+    {
+        lock_acquired(lock);
+        return true;
+    }
+    using Static = LockStatsStatic<true>;
+    long long start = Static::now();
+    if (!timed_acquire())
+        return false;
+    lock_acquired(lock, true, Static::now() - start);
+    return true;
+#else
+    if (!try_acquire() && !timed_acquire())
+        return false;
+    lock_acquired(lock);
+    return true;
+#endif
+}
+
+//  Wait on `condition` through `wait`, and report the time spent waiting.
+template<class Wait>
+inline auto profiled_wait (void const * condition, Wait && wait) -> decltype(wait())
+{
+#if defined(MINGW_STDTHREADS_LOCK_STATS)
+    struct Timer
+    {
+        void const * mCondition;
+        long long mStart;
+        ~Timer (void)
+        {
+            LockStatsStatic<true>::waited(mCondition, LockStatsStatic<true>::now() - mStart);
+        }
+    } timer { condition, LockStatsStatic<true>::now() };
+    (void)timer;
+#else
+    (void)condition;
+#endif
+    return wait();
+}
+} //  Namespace "detail"
+
+namespace lock_stats
+{
+//    Attach a name to a lock or condition variable, for use in reports. Pass a
+//  null pointer to remove the name. Has no effect unless
+//  MINGW_STDTHREADS_LOCK_STATS or MINGW_STDTHREADS_LOCK_ORDER_CHECKS is defined.
+inline void set_name (void const * lock, char const * name)
+{
+#if defined(MINGW_STDTHREADS_LOCK_STATS) || defined(MINGW_STDTHREADS_LOCK_ORDER_CHECKS)
+    using Static = detail::LockRegistryStatic<true>;
+    Static::lock_registry();
+    if (Static::sNames == nullptr)
+        Static::sNames = new std::unordered_map<void const *, std::string>();
+    if (name != nullptr)
+        (*Static::sNames)[lock] = name;
+    else
+        Static::sNames->erase(lock);
+    Static::unlock_registry();
+#else
+    (void)lock;
+    (void)name;
+#endif
+}
+
+//    Statistics for every lock seen so far, from both running and exited
+//  threads, sorted by decreasing wait time. Locks that did not fit into a
+//  thread's table are reported together, with a null address.
+inline std::vector<entry> snapshot (void)
+{
+    std::vector<entry> result;
+#if defined(MINGW_STDTHREADS_LOCK_STATS)
+    using Static = detail::LockStatsStatic<true>;
+    std::unordered_map<void const *, Static::Totals> totals;
+    Static::lock_registry();
+    if (Static::sRetired != nullptr)
+        totals = *Static::sRetired;
+    unsigned epoch = Static::sEpoch.load(std::memory_order_relaxed);
+    for (Static::ThreadTable * table = Static::sThreads; table != nullptr; table = table->mNext)
+    {
+//  A table from before the last reset has not been cleared yet.
+        if (table->mEpoch.load(std::memory_order_acquire) != epoch)
+            continue;
+        for (std::size_t i = 0; i <= Static::kSlots; ++i)
+        {
+            Static::Slot & slot = (i < Static::kSlots) ? table->mSlots[i] : table->mOverflow;
+            void const * lock = slot.mLock.load(std::memory_order_acquire);
+            if ((lock == nullptr) && (i < Static::kSlots))
+                continue;
+            Static::Totals & sum = totals[lock];
+            sum.mAcquisitions += slot.mAcquisitions.load(std::memory_order_relaxed);
+            sum.mContentions += slot.mContentions.load(std::memory_order_relaxed);
+            sum.mWaitTicks += slot.mWaitTicks.load(std::memory_order_relaxed);
+            sum.mHoldTicks += slot.mHoldTicks.load(std::memory_order_relaxed);
+        }
+    }
+    for (auto const & item : totals)
+    {
+        if (item.second.mAcquisitions == 0)
+            continue;
+        entry e { item.first, std::string(), item.second.mAcquisitions,
+                  item.second.mContentions, 0.0, 0.0 };
+        if (Static::sNames != nullptr)
+        {
+            auto name = Static::sNames->find(item.first);
+            if (name != Static::sNames->end())
+                e.name = name->second;
+        }
+        result.push_back(e);
+    }
+    Static::unlock_registry();
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    double seconds_per_tick = 1.0 / static_cast<double>(frequency.QuadPart);
+    for (entry & e : result)
+    {
+        Static::Totals const & sum = totals[e.lock];
+        e.wait_seconds = static_cast<double>(sum.mWaitTicks) * seconds_per_tick;
+        e.hold_seconds = static_cast<double>(sum.mHoldTicks) * seconds_per_tick;
+    }
+    std::sort(result.begin(), result.end(), [] (entry const & a, entry const & b)
+        {
+            if (a.wait_seconds != b.wait_seconds)
+                return a.wait_seconds > b.wait_seconds;
+            return a.contentions > b.contentions;
+        });
+#endif
+    return result;
+}
+
+//  Discard all statistics gathered so far. Names are kept.
+inline void reset (void)
+{
+#if defined(MINGW_STDTHREADS_LOCK_STATS)
+    using Static = detail::LockStatsStatic<true>;
+    Static::lock_registry();
+    Static::sEpoch.fetch_add(1, std::memory_order_relaxed);
+    if (Static::sRetired != nullptr)
+        Static::sRetired->clear();
+    Static::unlock_registry();
+#endif
+}
+
+//  Print the `max_entries` locks with the longest total wait time.
+inline void dump (std::FILE * out = stderr, std::size_t max_entries = 20)
+{
+#if defined(MINGW_STDTHREADS_LOCK_STATS)
+    std::vector<entry> entries = snapshot();
+    std::fprintf(out, "%-32s %14s %14s %8s %12s %12s\n", "lock", "acquisitions",
+                 "contended", "percent", "wait (ms)", "hold (ms)");
+    for (std::size_t i = 0; (i < entries.size()) && (i < max_entries); ++i)
+    {
+        entry const & e = entries[i];
+        char address [32];
+        if (e.lock == nullptr)
+            std::snprintf(address, sizeof(address), "(other locks)");
+        else
+            std::snprintf(address, sizeof(address), "%p", e.lock);
+        std::fprintf(out, "%-32s %14llu %14llu %7.2f%% %12.3f %12.3f\n",
+                     e.name.empty() ? address : e.name.c_str(), e.acquisitions,
+                     e.contentions, 100.0 * static_cast<double>(e.contentions) /
+                                    static_cast<double>(e.acquisitions),
+                     e.wait_seconds * 1e3, e.hold_seconds * 1e3);
+    }
+#else
+    (void)max_entries;
+    std::fprintf(out, "Lock statistics are disabled. Define "
+                      "MINGW_STDTHREADS_LOCK_STATS to enable them.\n");
+#endif
+}
+} //  Namespace "lock_stats"
+
+namespace lock_order
+{
+//    Install a function to be called with each lock-order cycle, instead of
+//  printing it to stderr. Pass a null pointer to restore the default. Returns
+//  the previous handler. The handler runs on the thread that completed the
+//  cycle, before it blocks; it may acquire locks, but their order is not
+//  checked.
+inline handler_type set_handler (handler_type handler) noexcept
+{
+#if defined(MINGW_STDTHREADS_LOCK_ORDER_CHECKS)
+    return detail::LockOrderStatic<true>::sHandler.exchange(handler,
+                                                            std::memory_order_acq_rel);
+#else
+    (void)handler;
+    return nullptr;
+#endif
+}
+
+//    Check only one in every `rate` blocking acquisitions on each thread. Pass
+//  0 to restore MINGW_STDTHREADS_LOCK_ORDER_SAMPLE.
+inline void set_sample_rate (unsigned rate) noexcept
+{
+#if defined(MINGW_STDTHREADS_LOCK_ORDER_CHECKS)
+    detail::LockOrderStatic<true>::sSampleRate.store(rate, std::memory_order_relaxed);
+#else
+    (void)rate;
+#endif
+}
+
+//    Discard the recorded orders involving `lock`. The library's locks do this
+//  when they are destroyed.
+inline void forget (void const * lock) noexcept
+{
+    detail::lock_destroyed(lock);
+}
+} //  Namespace "lock_order"
+} //  Namespace "mingw_stdthread"
+#endif // MINGW_LOCK_DIAGNOSTICS_H_
@@ -0,0 +1,223 @@
+/// \file mingw.lock_table.h
+/// \brief A table of mutexes (and, optionally, condition variables) selected
+///   by address, to protect many small objects without a mutex in each.
+///
+/// (c) 2013-2016 by Mega Limited, Auckland, New Zealand
+///
+/// \copyright Simplified (2-clause) BSD License.
+///
+/// \note This file may become part of the mingw-w64 runtime package. If/when
+/// this happens, the appropriate license will be added, i.e. this code will
+/// become dual-licensed, and the current BSD 2-clause license will stay.
+
+//    Objects that hash to the same slot share a mutex, so holding the mutex for
+//  one object may delay threads that work on another. Larger tables make this
+//  less likely. Each slot is padded to a cache line, so that threads working
+//  on different slots do not slow each other down through false sharing.
+//    lock_many acquires the mutexes for several objects at once. It locks each
+//  slot only once, even if several of the objects share it, and always locks
+//  slots in increasing order, so that two threads that lock overlapping sets of
+//  objects from the same table cannot deadlock.
+
+#ifndef MINGW_LOCK_TABLE_H_
+#define MINGW_LOCK_TABLE_H_
+
+#if !defined(__cplusplus) || (__cplusplus < 201103L)
+#error A C++11 compiler is required!
+#endif
+
+#include <cstddef>          //  For std::size_t
+#include <cstdint>          //  For std::uint64_t, std::uintptr_t
+#include <initializer_list>
+#include <memory>           //  For std::align
+#include <new>
+#include <type_traits>
+
+#include "mingw.mutex.h"
+
+namespace mingw_stdthread
+{
+namespace detail
+{
+template<class Mutex, class ConditionVariable>
+struct alignas(64) LockTableSlot
+{
+    Mutex mMutex;
+    ConditionVariable mCondition;
+};
+template<class Mutex>
+struct alignas(64) LockTableSlot<Mutex, void>
+{
+    Mutex mMutex;
+};
+
+//  A fixed number of slots, stored within the table.
+template<class Slot, std::size_t N>
+class LockTableStorage
+{
+    Slot mSlots [N];
+protected:
+    LockTableStorage (void) = default;
+    std::size_t slot_count (void) const noexcept
+    {
+        return N;
+    }
+    Slot & slot (std::size_t index) noexcept
+    {
+        return mSlots[index];
+    }
+};
+
+//    A number of slots chosen at run time. Before C++17, operator new ignores
+//  the alignment of the type, so the slots are aligned by hand.
+template<class Slot>
+class LockTableStorage<Slot, 0>
+{
+    void * mMemory;
+    Slot * mSlots;
+    std::size_t mCount;
+protected:
+    explicit LockTableStorage (std::size_t count)
+        : mMemory(nullptr), mSlots(nullptr), mCount(0)
+    {
+        if (count == 0)
+            count = 1;
+        std::size_t space = count * sizeof(Slot) + alignof(Slot);
+        mMemory = ::operator new(space);
+        void * aligned = mMemory;
+        mSlots = static_cast<Slot *>(std::align(alignof(Slot), count * sizeof(Slot),
+                                                aligned, space));
+        try {
+            for (; mCount < count; ++mCount)
+                new (mSlots + mCount) Slot();
+        } catch (...) {
+            destroy();
+            throw;
+        }
+    }
+    ~LockTableStorage (void)
+    {
+        destroy();
+    }
+    std::size_t slot_count (void) const noexcept
+    {
+        return mCount;
+    }
+    Slot & slot (std::size_t index) noexcept
+    {
+        return mSlots[index];
+    }
+private:
+    void destroy (void) noexcept
+    {
+        while (mCount != 0)
+            mSlots[--mCount].~Slot();
+        ::operator delete(mMemory);
+    }
+};
+} //  Namespace "detail"
+
+//    Maps addresses onto N mutexes, each paired with a ConditionVariable unless
+//  that is void. If N is 0, the number of slots is passed to the constructor.
+template<std::size_t N, class Mutex = mutex, class ConditionVariable = void>
+class lock_table
+    : private detail::LockTableStorage<detail::LockTableSlot<Mutex, ConditionVariable>, N>
+{
+    typedef detail::LockTableSlot<Mutex, ConditionVariable> Slot;
+    typedef detail::LockTableStorage<Slot, N> Base;
+    using Base::slot_count;
+    using Base::slot;
+
+//    Unlocks, once each, the slots used by [first, last) whose indices are
+//  below `end`.
+    template<class ForwardIt>
+    void unlock_below (ForwardIt first, ForwardIt last, std::size_t end)
+    {
+        for (ForwardIt it = first; it != last; ++it)
+        {
+            std::size_t index = index_of(*it);
+            if (index >= end)
+                continue;
+            ForwardIt other = first;
+            while ((other != it) && (index_of(*other) != index))
+                ++other;
+            if (other == it)
+                slot(index).mMutex.unlock();
+        }
+    }
+public:
+    typedef Mutex mutex_type;
+    typedef ConditionVariable condition_variable_type;
+
+    lock_table (void) = default;
+    explicit lock_table (std::size_t count) : Base(count) { }
+    lock_table (lock_table const &) = delete;
+    lock_table & operator= (lock_table const &) = delete;
+
+    std::size_t size (void) const noexcept
+    {
+        return slot_count();
+    }
+//    Addresses are usually aligned, and often equally spaced, so their low
+//  bits are scrambled before the division.
+    std::size_t index_of (void const * address) const noexcept
+    {
+        std::uint64_t bits = reinterpret_cast<std::uintptr_t>(address);
+        return static_cast<std::size_t>(((bits * 0x9E3779B97F4A7C15ull) >> 32) % size());
+    }
+    mutex_type & mutex_for (void const * address) noexcept
+    {
+        return slot(index_of(address)).mMutex;
+    }
+    template<class C = ConditionVariable>
+    C & condition_variable_for (void const * address) noexcept
+    {
+        static_assert(!std::is_void<C>::value,
+                      "This lock_table has no condition variables.");
+        return slot(index_of(address)).mCondition;
+    }
+
+//    Locks the mutexes for every address in [first, last), in order of slot.
+//  Meant for a handful of addresses; the cost grows with the square of their
+//  number.
+    template<class ForwardIt>
+    void lock_many (ForwardIt first, ForwardIt last)
+    {
+        std::size_t end = 0;
+        for (;;)
+        {
+//  Find the lowest slot that has not been locked yet.
+            std::size_t next = size();
+            for (ForwardIt it = first; it != last; ++it)
+            {
+                std::size_t index = index_of(*it);
+                if ((index >= end) && (index < next))
+                    next = index;
+            }
+            if (next == size())
+                return;
+            try {
+                slot(next).mMutex.lock();
+            } catch (...) {
+                unlock_below(first, last, next);
+                throw;
+            }
+            end = next + 1;
+        }
+    }
+    void lock_many (std::initializer_list<void const *> addresses)
+    {
+        lock_many(addresses.begin(), addresses.end());
+    }
+    template<class ForwardIt>
+    void unlock_many (ForwardIt first, ForwardIt last)
+    {
+        unlock_below(first, last, size());
+    }
+    void unlock_many (std::initializer_list<void const *> addresses)
+    {
+        unlock_many(addresses.begin(), addresses.end());
+    }
+};
+} //  Namespace "mingw_stdthread"
+#endif // MINGW_LOCK_TABLE_H_
@@ -37,6 +37,7 @@
 #include <chrono>
 #include <system_error>
 #include <atomic>
+#include <cstdint>  //  For std::uint32_t
 #include <mutex> //need for call_once()
 
 #if STDMUTEX_RECURSION_CHECKS || !defined(NDEBUG)
@@ -51,9 +52,7 @@
  guarantees. This problem does not exist in MinGW-w64."
 #include <windows.h>    //  No further granularity can be expected.
 #else
-#if STDMUTEX_RECURSION_CHECKS
 #include <processthreadsapi.h>  //  For GetCurrentThreadId
-#endif
 #include <synchapi.h> //  For InitializeCriticalSection, etc.
 #include <errhandlingapi.h> //  For GetLastError
 #include <handleapi.h>
@@ -61,6 +60,10 @@
 
 //  Need for the implementation of invoke
 #include "mingw.invoke.h"
+//  For the timed mutexes, which wait on a lock word.
+#include "mingw.wait_on_address.h"
+//  For the optional lock statistics.
+#include "mingw.lock_diagnostics.h"
 
 #if !defined(_WIN32_WINNT) || (_WIN32_WINNT < 0x0501)
 #error To use the MinGW-std-threads library, you will need to define the macro _WIN32_WINNT to be 0x0501 (Windows XP) or higher.
@@ -71,12 +74,14 @@ namespace mingw_stdthread
 //    The _NonRecursive class has mechanisms that do not play nice with direct
 //  manipulation of the native handle. This forward declaration is part of
 //  a friend class declaration.
-#if STDMUTEX_RECURSION_CHECKS
 namespace vista
 {
 class condition_variable;
 }
-#endif
+namespace detail
+{
+struct lock_releaser;
+}
 //    To make this namespace equivalent to the thread-related subset of std,
 //  pull in the classes and class templates supplied by std but not by this
 //  implementation.
@@ -89,6 +94,8 @@ using std::adopt_lock;
 using std::defer_lock;
 using std::try_to_lock;
 
+namespace xp
+{
 class recursive_mutex
 {
     CRITICAL_SECTION mHandle;
@@ -103,21 +110,47 @@ public:
     recursive_mutex& operator=(const recursive_mutex&) = delete;
     ~recursive_mutex() noexcept
     {
+        detail::lock_destroyed(this);
         DeleteCriticalSection(&mHandle);
     }
     void lock()
     {
-        EnterCriticalSection(&mHandle);
+        detail::profiled_lock(this,
+            [this] { return TryEnterCriticalSection(&mHandle) != 0; },
+            [this] { EnterCriticalSection(&mHandle); });
     }
     void unlock()
     {
+        detail::lock_released(this);
         LeaveCriticalSection(&mHandle);
     }
     bool try_lock()
     {
-        return (TryEnterCriticalSection(&mHandle)!=0);
+        bool ret = (TryEnterCriticalSection(&mHandle)!=0);
+        if (ret)
+            detail::lock_acquired(this);
+        return ret;
     }
 };
+} //  Namespace "xp"
+
+namespace detail
+{
+//    Equivalent to GetCurrentThreadId, without the call: the ID is read from
+//  the thread's own environment block, as GetCurrentThreadId itself does. The
+//  segment-register intrinsics come with winnt.h, which uses them for
+//  NtCurrentTeb.
+inline DWORD current_thread_id (void) noexcept
+{
+#if defined(__MINGW64_VERSION_MAJOR) && defined(__x86_64__)
+    return __readgsdword(0x48);
+#elif defined(__MINGW64_VERSION_MAJOR) && defined(__i386__)
+    return __readfsdword(0x24);
+#else
+    return GetCurrentThreadId();
+#endif
+}
+} //  Namespace "detail"
 
 #if STDMUTEX_RECURSION_CHECKS
 struct _OwnerThread
@@ -136,7 +169,7 @@ struct _OwnerThread
     }
     DWORD checkOwnerBeforeLock() const
     {
-        DWORD self = GetCurrentThreadId();
+        DWORD self = detail::current_thread_id();
         if (mOwnerThread.load(std::memory_order_relaxed) == self)
             on_deadlock();
         return self;
@@ -147,7 +180,7 @@ struct _OwnerThread
     }
     void checkSetOwnerBeforeUnlock()
     {
-        DWORD self = GetCurrentThreadId();
+        DWORD self = detail::current_thread_id();
         if (mOwnerThread.load(std::memory_order_relaxed) != self)
             on_deadlock();
         mOwnerThread.store(0, std::memory_order_relaxed);
@@ -175,6 +208,7 @@ class mutex
 //  Track locking thread for error checking.
 #if STDMUTEX_RECURSION_CHECKS
     friend class vista::condition_variable;
+    friend class adaptive_mutex;
     _OwnerThread mOwnerThread {};
 #endif
 public:
@@ -185,13 +219,24 @@ public:
 #pragma GCC diagnostic pop
     mutex (const mutex&) = delete;
     mutex & operator= (const mutex&) = delete;
+#if defined(MINGW_STDTHREADS_LOCK_ORDER_CHECKS)
+//    Otherwise trivially destructible. The lock-order checks identify locks
+//  by address, so each lock must drop its orders before its memory is reused.
+    ~mutex (void) { detail::lock_destroyed(this); }
+#endif
     void lock (void)
     {
 //  Note: Undefined behavior if called recursively.
 #if STDMUTEX_RECURSION_CHECKS
         DWORD self = mOwnerThread.checkOwnerBeforeLock();
 #endif
-        AcquireSRWLockExclusive(&mHandle);
+#if (WINVER >= _WIN32_WINNT_WIN7)
+        detail::profiled_lock(this,
+            [this] { return TryAcquireSRWLockExclusive(&mHandle) != 0; },
+            [this] { AcquireSRWLockExclusive(&mHandle); });
+#else
+        detail::profiled_lock(this, [this] { AcquireSRWLockExclusive(&mHandle); });
+#endif
 #if STDMUTEX_RECURSION_CHECKS
         mOwnerThread.setOwnerAfterLock(self);
 #endif
@@ -201,6 +246,7 @@ public:
 #if STDMUTEX_RECURSION_CHECKS
         mOwnerThread.checkSetOwnerBeforeUnlock();
 #endif
+        detail::lock_released(this);
         ReleaseSRWLockExclusive(&mHandle);
     }
 //  TryAcquireSRW functions are a Windows 7 feature.
@@ -211,6 +257,8 @@ public:
         DWORD self = mOwnerThread.checkOwnerBeforeLock();
 #endif
         BOOL ret = TryAcquireSRWLockExclusive(&mHandle);
+        if (ret)
+            detail::lock_acquired(this);
 #if STDMUTEX_RECURSION_CHECKS
         if (ret)
             mOwnerThread.setOwnerAfterLock(self);
@@ -223,8 +271,292 @@ public:
         return &mHandle;
     }
 };
+
+//    AcquireSRWLockExclusive only spins for a short, fixed time before it puts
+//  the thread to sleep in the kernel. When critical sections are short, the
+//  resulting context switches cost far more than the critical sections
+//  themselves. This mutex spins first, backing off exponentially between
+//  attempts, and adapts the amount of spinning to the recent history of each
+//  instance: spins that end in acquisition pull the estimate toward the number
+//  of iterations that were needed, and spins that end in the kernel shrink it.
+//    The spin relies on TryAcquireSRWLockExclusive, a Windows 7 feature.
+#if (WINVER >= _WIN32_WINNT_WIN7)
+class adaptive_mutex
+{
+    static constexpr unsigned kMinSpin = 16;
+    static constexpr unsigned kMaxSpin = 4096;
+    static constexpr unsigned kMaxBackoff = 64;
+//    The SRW lock handles parking, and lets condition_variable wait natively.
+//  lock() acquires it directly and reports as this mutex, so that acquisitions
+//  won by spinning record lock orders and count as contended. The other
+//  members go through mBase, which shares this mutex's address.
+    mutex mBase;
+//    Set by the owner while it holds mBase. Spinning threads read this word,
+//  rather than the SRW lock's undocumented internals, and only try to claim the
+//  lock once it is clear, so that they do not bounce the cache line with
+//  read-modify-write operations. It is a hint: mBase alone decides ownership.
+    std::atomic<bool> mHeld;
+    std::atomic<unsigned> mSpinEstimate;
+//  Clears and sets mHeld around its waits, which release mBase natively.
+    friend class vista::condition_variable;
+
+    bool appears_unlocked (void) const
+    {
+        return !mHeld.load(std::memory_order_relaxed);
+    }
+    void set_held (bool held)
+    {
+        mHeld.store(held, std::memory_order_relaxed);
+    }
+    bool try_acquire (void)
+    {
+        return TryAcquireSRWLockExclusive(mBase.native_handle()) != 0;
+    }
+//    The first attempt is made before any spinning, so this is also the
+//  uncontended path. Only attempts after a spin adjust the estimate.
+    void spin_then_park (void)
+    {
+        unsigned estimate = mSpinEstimate.load(std::memory_order_relaxed);
+        unsigned budget = 2 * estimate + kMinSpin;
+        if (budget > kMaxSpin)
+            budget = kMaxSpin;
+        unsigned spun = 0;
+        unsigned backoff = 1;
+        for (;;)
+        {
+            if (appears_unlocked() && try_acquire())
+            {
+                if (spun != 0)
+                {
+                    estimate = (spun > estimate) ? estimate + (spun - estimate) / 8
+                                                 : estimate - (estimate - spun) / 8;
+                    mSpinEstimate.store(estimate, std::memory_order_relaxed);
+                }
+                return;
+            }
+            if (spun >= budget)
+                break;
+            for (unsigned i = 0; i < backoff; ++i)
+                YieldProcessor();
+            spun += backoff;
+            if (backoff < kMaxBackoff)
+                backoff *= 2;
+        }
+        AcquireSRWLockExclusive(mBase.native_handle());
+//  Spinning did not pay off. Give up sooner next time.
+        mSpinEstimate.store(estimate - estimate / 4, std::memory_order_relaxed);
+    }
+public:
+    typedef mutex::native_handle_type native_handle_type;
+    constexpr adaptive_mutex () noexcept
+        : mBase(), mHeld(false), mSpinEstimate(0) { }
+    adaptive_mutex (const adaptive_mutex&) = delete;
+    adaptive_mutex & operator= (const adaptive_mutex&) = delete;
+    void lock (void)
+    {
+#if STDMUTEX_RECURSION_CHECKS
+        DWORD self = mBase.mOwnerThread.checkOwnerBeforeLock();
+#endif
+        detail::profiled_lock(this, [this] { return try_acquire(); },
+                                    [this] { spin_then_park(); });
+#if STDMUTEX_RECURSION_CHECKS
+        mBase.mOwnerThread.setOwnerAfterLock(self);
+#endif
+        set_held(true);
+    }
+    void unlock (void)
+    {
+        set_held(false);
+        mBase.unlock();
+    }
+    bool try_lock (void)
+    {
+        bool locked = mBase.try_lock();
+        if (locked)
+            set_held(true);
+        return locked;
+    }
+    native_handle_type native_handle (void)
+    {
+        return mBase.native_handle();
+    }
+};
+
+//    A CRITICAL_SECTION must be initialized and deleted at run time, and carries
+//  spin and debugging state that cannot be removed. This recursive mutex is an
+//  SRW lock with an owner and a recursion count instead: it is constant-
+//  initialized, trivially destructible, and 16 bytes in 64-bit builds. Re-entry
+//  by the owner is a plain compare, without any atomic read-modify-write.
+//    The owner is read by threads that do not hold the lock, but only the owner
+//  itself can ever find its own ID there, so relaxed accesses suffice. The count
+//  is only accessed by the owner.
+//    try_lock relies on TryAcquireSRWLockExclusive, a Windows 7 feature.
+class recursive_mutex
+{
+    SRWLOCK mHandle;
+    std::atomic<DWORD> mOwnerThread;
+    DWORD mRecursionCount;
+//  Save and restore the owner and the count around their waits.
+    friend class vista::condition_variable;
+    friend struct detail::lock_releaser;
+    void set_owner (DWORD self)
+    {
+        mOwnerThread.store(self, std::memory_order_relaxed);
+        mRecursionCount = 1;
+    }
+public:
+    typedef PSRWLOCK native_handle_type;
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wzero-as-null-pointer-constant"
+    constexpr recursive_mutex () noexcept
+        : mHandle(SRWLOCK_INIT), mOwnerThread(0), mRecursionCount(0) { }
+#pragma GCC diagnostic pop
+    recursive_mutex (const recursive_mutex&) = delete;
+    recursive_mutex & operator= (const recursive_mutex&) = delete;
+#if defined(MINGW_STDTHREADS_LOCK_ORDER_CHECKS)
+    ~recursive_mutex (void) { detail::lock_destroyed(this); }
+#endif
+    void lock (void)
+    {
+        DWORD self = detail::current_thread_id();
+        if (mOwnerThread.load(std::memory_order_relaxed) == self)
+        {
+            ++mRecursionCount;
+            return;
+        }
+        detail::profiled_lock(this,
+            [this] { return TryAcquireSRWLockExclusive(&mHandle) != 0; },
+            [this] { AcquireSRWLockExclusive(&mHandle); });
+        set_owner(self);
+    }
+    void unlock (void)
+    {
+#if STDMUTEX_RECURSION_CHECKS
+        if (mOwnerThread.load(std::memory_order_relaxed) != detail::current_thread_id())
+            throw std::system_error(make_error_code(std::errc::operation_not_permitted));
+#endif
+        if (--mRecursionCount != 0)
+            return;
+        mOwnerThread.store(0, std::memory_order_relaxed);
+        detail::lock_released(this);
+        ReleaseSRWLockExclusive(&mHandle);
+    }
+    bool try_lock (void)
+    {
+        DWORD self = detail::current_thread_id();
+        if (mOwnerThread.load(std::memory_order_relaxed) == self)
+        {
+            ++mRecursionCount;
+            return true;
+        }
+        if (!TryAcquireSRWLockExclusive(&mHandle))
+            return false;
+        detail::lock_acquired(this);
+        set_owner(self);
+        return true;
+    }
+    native_handle_type native_handle (void)
+    {
+        return &mHandle;
+    }
+};
+#endif
 } //  Namespace windows7
 #endif  //  Compiling for Vista
+
+//    WaitOnAddress makes it possible to build a mutex from a single 32-bit word,
+//  using the three-state protocol of Drepper's "Futexes Are Tricky": the word is
+//  0 when unlocked, 1 when locked, and 2 when locked with possible waiters. The
+//  uncontended lock and unlock are each a single atomic operation, and unlock
+//  only calls into the system when some thread may be waiting.
+//    Note: WaitOnAddress is exported by the synchronization import library.
+#if (WINVER >= _WIN32_WINNT_WIN8)
+namespace windows8
+{
+class mutex
+{
+    static constexpr DWORD kInfinite = 0xffffffffl;
+    static constexpr std::uint32_t kUnlocked = 0;
+    static constexpr std::uint32_t kLocked = 1;
+    static constexpr std::uint32_t kContended = 2;
+    std::atomic<std::uint32_t> mState;
+//  Track locking thread for error checking.
+#if STDMUTEX_RECURSION_CHECKS
+    _OwnerThread mOwnerThread {};
+#endif
+    void lock_contended (std::uint32_t state)
+    {
+//    Mark the mutex as contended before sleeping, so that the thread which
+//  releases it knows to wake a waiter. Whoever acquires the mutex this way must
+//  also leave it marked, because other threads may still be waiting.
+        if (state != kContended)
+            state = mState.exchange(kContended, std::memory_order_acquire);
+        while (state != kUnlocked)
+        {
+            std::uint32_t contended = kContended;
+            WaitOnAddress(&mState, &contended, sizeof(contended), kInfinite);
+            state = mState.exchange(kContended, std::memory_order_acquire);
+        }
+    }
+public:
+    typedef std::atomic<std::uint32_t> * native_handle_type;
+    constexpr mutex () noexcept : mState(kUnlocked) { }
+    mutex (const mutex&) = delete;
+    mutex & operator= (const mutex&) = delete;
+#if defined(MINGW_STDTHREADS_LOCK_ORDER_CHECKS)
+    ~mutex (void) { detail::lock_destroyed(this); }
+#endif
+    void lock (void)
+    {
+//  Note: Undefined behavior if called recursively.
+#if STDMUTEX_RECURSION_CHECKS
+        DWORD self = mOwnerThread.checkOwnerBeforeLock();
+#endif
+        std::uint32_t state = kUnlocked;
+        detail::profiled_try_then_lock(this,
+            [this, &state] {
+                return mState.compare_exchange_strong(state, kLocked,
+                                                      std::memory_order_acquire,
+                                                      std::memory_order_relaxed);
+            },
+            [this, &state] { lock_contended(state); });
+#if STDMUTEX_RECURSION_CHECKS
+        mOwnerThread.setOwnerAfterLock(self);
+#endif
+    }
+    void unlock (void)
+    {
+#if STDMUTEX_RECURSION_CHECKS
+        mOwnerThread.checkSetOwnerBeforeUnlock();
+#endif
+        detail::lock_released(this);
+        if (mState.exchange(kUnlocked, std::memory_order_release) == kContended)
+            WakeByAddressSingle(&mState);
+    }
+    bool try_lock (void)
+    {
+#if STDMUTEX_RECURSION_CHECKS
+        DWORD self = mOwnerThread.checkOwnerBeforeLock();
+#endif
+        std::uint32_t state = kUnlocked;
+        bool ret = mState.compare_exchange_strong(state, kLocked,
+                                                  std::memory_order_acquire,
+                                                  std::memory_order_relaxed);
+        if (ret)
+            detail::lock_acquired(this);
+#if STDMUTEX_RECURSION_CHECKS
+        if (ret)
+            mOwnerThread.setOwnerAfterLock(self);
+#endif
+        return ret;
+    }
+    native_handle_type native_handle (void)
+    {
+        return &mState;
+    }
+};
+} //  Namespace windows8
+#endif  //  Compiling for Windows 8
 namespace xp
 {
 class mutex
@@ -246,6 +578,7 @@ public:
 //    Undefined behavior if the mutex is held (locked) by any thread.
 //    Undefined behavior if a thread terminates while holding ownership of the
 //  mutex.
+        detail::lock_destroyed(this);
         DeleteCriticalSection(&mHandle);
     }
     void lock (void)
@@ -267,7 +600,9 @@ public:
 #if STDMUTEX_RECURSION_CHECKS
         DWORD self = mOwnerThread.checkOwnerBeforeLock();
 #endif
-        EnterCriticalSection(&mHandle);
+        detail::profiled_lock(this,
+            [this] { return TryEnterCriticalSection(&mHandle) != 0; },
+            [this] { EnterCriticalSection(&mHandle); });
 #if STDMUTEX_RECURSION_CHECKS
         mOwnerThread.setOwnerAfterLock(self);
 #endif
@@ -277,6 +612,7 @@ public:
 #if STDMUTEX_RECURSION_CHECKS
         mOwnerThread.checkSetOwnerBeforeUnlock();
 #endif
+        detail::lock_released(this);
         LeaveCriticalSection(&mHandle);
     }
     bool try_lock (void)
@@ -293,6 +629,8 @@ public:
         DWORD self = mOwnerThread.checkOwnerBeforeLock();
 #endif
         BOOL ret = TryEnterCriticalSection(&mHandle);
+        if (ret)
+            detail::lock_acquired(this);
 #if STDMUTEX_RECURSION_CHECKS
         if (ret)
             mOwnerThread.setOwnerAfterLock(self);
@@ -305,91 +643,397 @@ public:
     }
 };
 } //  Namespace "xp"
-#if (WINVER >= _WIN32_WINNT_WIN7)
+//    The adaptive mutex must be requested explicitly, because spinning wastes
+//  processor time whenever critical sections are long.
+#if (WINVER >= _WIN32_WINNT_WIN7) && defined(MINGW_STDTHREADS_ADAPTIVE_MUTEX)
+using mutex = windows7::adaptive_mutex;
+#elif (WINVER >= _WIN32_WINNT_WIN8)
+using windows8::mutex;
+#elif (WINVER >= _WIN32_WINNT_WIN7)
 using windows7::mutex;
 #else
 using xp::mutex;
 #endif
+#if (WINVER >= _WIN32_WINNT_WIN7)
+using windows7::recursive_mutex;
+#else
+using xp::recursive_mutex;
+#endif
 
-class recursive_timed_mutex
+namespace detail
 {
-    static constexpr DWORD kWaitAbandoned = 0x00000080l;
-    static constexpr DWORD kWaitObject0 = 0x00000000l;
-    static constexpr DWORD kInfinite = 0xffffffffl;
-    inline bool try_lock_internal (DWORD ms) noexcept
+//    The lock word shared by timed_mutex and recursive_timed_mutex. It uses the
+//  same three-state protocol as windows8::mutex, but waits through
+//  wait_on_address, which is available (natively or emulated) on every
+//  supported version of Windows. Neither mutex needs a kernel object, and a
+//  thread only enters the kernel when it has to wait.
+class timed_lock_word
+{
+    static constexpr std::uint32_t kUnlocked = 0;
+    static constexpr std::uint32_t kLocked = 1;
+    static constexpr std::uint32_t kContended = 2;
+    std::atomic<std::uint32_t> mState;
+public:
+    typedef std::atomic<std::uint32_t> * native_handle_type;
+    constexpr timed_lock_word () noexcept : mState(kUnlocked) { }
+    timed_lock_word (const timed_lock_word&) = delete;
+    timed_lock_word & operator= (const timed_lock_word&) = delete;
+    bool try_lock (void) noexcept
+    {
+        std::uint32_t state = kUnlocked;
+        return mState.compare_exchange_strong(state, kLocked,
+                                              std::memory_order_acquire,
+                                              std::memory_order_relaxed);
+    }
+//    Mark the word as contended before sleeping, so that the thread which
+//  releases it knows to wake a waiter. A waiter that gives up leaves the mark in
+//  place; at worst, this costs the owner one unnecessary wake.
+    bool try_lock_until (std::chrono::steady_clock::time_point deadline) noexcept
     {
-        DWORD ret = WaitForSingleObject(mHandle, ms);
-#ifndef NDEBUG
-        if (ret == kWaitAbandoned)
+        if (try_lock())
+            return true;
+        std::uint32_t state = mState.exchange(kContended, std::memory_order_acquire);
+        while (state != kUnlocked)
         {
-            using namespace std;
-            fprintf(stderr, "FATAL: Thread terminated while holding a mutex.");
-            terminate();
+            if (!wait_on_address_until(mState, kContended, deadline))
+                return false;
+            state = mState.exchange(kContended, std::memory_order_acquire);
+        }
+        return true;
+    }
+    void lock (void) noexcept
+    {
+        try_lock_until(std::chrono::steady_clock::time_point::max());
+    }
+    void unlock (void) noexcept
+    {
+        if (mState.exchange(kUnlocked, std::memory_order_release) == kContended)
+            wake_by_address_single(mState);
+    }
+    native_handle_type native_handle (void) noexcept
+    {
+        return &mState;
+    }
+};
+} //  Namespace "detail"
+
+//    A mutex that always detects recursive locking, and unlocking by a thread
+//  other than the owner, at no cost to the uncontended paths. Instead of
+//  tracking the owner separately (as STDMUTEX_RECURSION_CHECKS does), the lock
+//  word holds the ID of the owning thread, or 0 when unlocked: lock is a single
+//  compare-exchange from 0 to the caller's ID, and unlock a single compare-
+//  exchange back, which fails if the caller is not the owner. Only a failed
+//  compare-exchange, which would have to wait anyway, looks at the owner.
+//    Thread IDs are indices into the kernel's handle table, and therefore
+//  multiples of 4. The lowest bit marks that other threads may be waiting, as
+//  the third state of timed_lock_word does.
+//    Waiting goes through wait_on_address, so this mutex is available on every
+//  supported version of Windows.
+class checked_mutex
+{
+    static constexpr std::uint32_t kUnlocked = 0;
+    static constexpr std::uint32_t kWaiters = 1;
+    std::atomic<std::uint32_t> mState;
+    static void on_misuse (std::errc code)
+    {
+        throw std::system_error(make_error_code(code));
+    }
+//    `state` is the value that the failed compare-exchange found. Whoever
+//  acquires the mutex here must leave it marked, because other threads may
+//  still be waiting.
+    void lock_contended (std::uint32_t self, std::uint32_t state)
+    {
+        if ((state & ~kWaiters) == self)
+            on_misuse(std::errc::resource_deadlock_would_occur);
+        for (;;)
+        {
+            if (state == kUnlocked)
+            {
+                if (mState.compare_exchange_weak(state, self | kWaiters,
+                                                 std::memory_order_acquire,
+                                                 std::memory_order_relaxed))
+                    return;
+            }
+            else if ((state & kWaiters) || mState.compare_exchange_weak(state,
+                                                    state | kWaiters,
+                                                    std::memory_order_relaxed,
+                                                    std::memory_order_relaxed))
+            {
+                detail::wait_on_address(mState, state | kWaiters,
+                                        detail::kAddressWaitInfinite);
+                state = mState.load(std::memory_order_relaxed);
+            }
         }
-#endif
-        return (ret == kWaitObject0) || (ret == kWaitAbandoned);
     }
-protected:
-    HANDLE mHandle;
-//    Track locking thread for error checking of non-recursive timed_mutex. For
-//  standard compliance, this must be defined in same class and at the same
-//  access-control level as every other variable in the timed_mutex.
-#if STDMUTEX_RECURSION_CHECKS
-    friend class vista::condition_variable;
-    _OwnerThread mOwnerThread {};
-#endif
 public:
-    typedef HANDLE native_handle_type;
-    native_handle_type native_handle() const {return mHandle;}
-    recursive_timed_mutex(const recursive_timed_mutex&) = delete;
-    recursive_timed_mutex& operator=(const recursive_timed_mutex&) = delete;
-    recursive_timed_mutex(): mHandle(CreateMutex(NULL, FALSE, NULL)) {}
-    ~recursive_timed_mutex()
+    typedef std::atomic<std::uint32_t> * native_handle_type;
+    constexpr checked_mutex () noexcept : mState(kUnlocked) { }
+    checked_mutex (const checked_mutex&) = delete;
+    checked_mutex & operator= (const checked_mutex&) = delete;
+#if defined(MINGW_STDTHREADS_LOCK_ORDER_CHECKS)
+    ~checked_mutex (void) { detail::lock_destroyed(this); }
+#endif
+    void lock (void)
     {
-        CloseHandle(mHandle);
+        std::uint32_t self = detail::current_thread_id();
+        std::uint32_t state = kUnlocked;
+        detail::profiled_try_then_lock(this,
+            [this, self, &state] {
+                return mState.compare_exchange_strong(state, self,
+                                                      std::memory_order_acquire,
+                                                      std::memory_order_relaxed);
+            },
+            [this, self, &state] { lock_contended(self, state); });
     }
-    void lock()
+    void unlock (void)
+    {
+        std::uint32_t self = detail::current_thread_id();
+        std::uint32_t state = self;
+        if (mState.compare_exchange_strong(state, kUnlocked,
+                                           std::memory_order_release,
+                                           std::memory_order_relaxed))
+        {
+            detail::lock_released(this);
+            return;
+        }
+        if ((state & ~kWaiters) != self)
+            on_misuse(std::errc::operation_not_permitted);
+//  Once marked, the word is only changed by its owner.
+        detail::lock_released(this);
+        mState.store(kUnlocked, std::memory_order_release);
+        detail::wake_by_address_single(mState);
+    }
+    bool try_lock (void)
     {
-        DWORD ret = WaitForSingleObject(mHandle, kInfinite);
-//    If (ret == WAIT_ABANDONED), then the thread that held ownership was
-//  terminated. Behavior is undefined, but Windows will pass ownership to this
-//  thread.
-#ifndef NDEBUG
-        if (ret == kWaitAbandoned)
+        std::uint32_t self = detail::current_thread_id();
+        std::uint32_t state = kUnlocked;
+        if (mState.compare_exchange_strong(state, self, std::memory_order_acquire,
+                                           std::memory_order_relaxed))
         {
-            using namespace std;
-            fprintf(stderr, "FATAL: Thread terminated while holding a mutex.");
-            terminate();
+            detail::lock_acquired(this);
+            return true;
         }
+        if ((state & ~kWaiters) == self)
+            on_misuse(std::errc::resource_deadlock_would_occur);
+        return false;
+    }
+    native_handle_type native_handle (void)
+    {
+        return &mState;
+    }
+};
+
+//    A fair queue lock for heavily contended locks, after Mellor-Crummey and
+//  Scott. With other mutexes, every waiter polls the same lock word, so each
+//  release sends its cache line to all of them, and any of them may win. Here,
+//  waiters form a queue, and each one spins on a node of its own, padded to a
+//  cache line. A release touches only the node of the next waiter in line, and
+//  hands the lock directly to it.
+//    To provide the Lockable interface, where unlock takes no argument, this is
+//  the variant from the K42 operating system: the lock itself serves as the
+//  queue node of its owner. A waiter's node lives on its stack, and only until
+//  the waiter has acquired the lock.
+//    A waiter that is not served within a bounded spin sleeps through
+//  wait_on_address, so this mutex is available on every supported version of
+//  Windows. Because hand-off is strictly first-come, first-served, a waiter that
+//  is descheduled delays everyone behind it; under light contention, mutex is
+//  faster.
+class queue_mutex
+{
+    static constexpr unsigned kSpinLimit = 1024;
+    static constexpr std::uint32_t kWaiting = 0;
+    static constexpr std::uint32_t kSleeping = 1;
+    static constexpr std::uint32_t kGranted = 2;
+    struct Link
+    {
+        std::atomic<Link *> mNext;
+    };
+    struct alignas(64) Node : Link
+    {
+        std::atomic<std::uint32_t> mState;
+    };
+//    The last entry in the queue: null if unlocked, &mHead if locked without
+//  waiters, and otherwise the node of the last waiter.
+    std::atomic<Link *> mTail;
+//  The owner's entry. Its successor is the first waiter, if any.
+    Link mHead;
+
+    bool try_lock_impl (void) noexcept
+    {
+        Link * expected = nullptr;
+        return mTail.compare_exchange_strong(expected, &mHead, std::memory_order_acquire,
+                                             std::memory_order_relaxed);
+    }
+    static void wait_for_grant (Node & node) noexcept
+    {
+        for (unsigned i = 0; i < kSpinLimit; ++i)
+        {
+            if (node.mState.load(std::memory_order_acquire) == kGranted)
+                return;
+            YieldProcessor();
+        }
+        std::uint32_t state = kWaiting;
+        if (!node.mState.compare_exchange_strong(state, kSleeping, std::memory_order_acquire))
+            return;
+        do
+            detail::wait_on_address(node.mState, kSleeping, detail::kAddressWaitInfinite);
+        while (node.mState.load(std::memory_order_acquire) != kGranted);
+    }
+    void lock_queued (void) noexcept
+    {
+        Node node;
+        for (;;)
+        {
+            Link * prev = mTail.load(std::memory_order_relaxed);
+            if (prev == nullptr)
+            {
+                if (mTail.compare_exchange_weak(prev, &mHead, std::memory_order_acquire,
+                                                std::memory_order_relaxed))
+                    return;
+                continue;
+            }
+            node.mNext.store(nullptr, std::memory_order_relaxed);
+            node.mState.store(kWaiting, std::memory_order_relaxed);
+            if (!mTail.compare_exchange_weak(prev, &node, std::memory_order_acq_rel,
+                                             std::memory_order_relaxed))
+                continue;
+            prev->mNext.store(&node, std::memory_order_release);
+            wait_for_grant(node);
+//    Take over from the node on the stack. If there is no successor yet, try
+//  to make the lock its own tail; failing that, one is about to link itself.
+            Link * next = node.mNext.load(std::memory_order_acquire);
+            if (next == nullptr)
+            {
+                mHead.mNext.store(nullptr, std::memory_order_relaxed);
+                Link * expected = &node;
+                if (mTail.compare_exchange_strong(expected, &mHead, std::memory_order_acq_rel,
+                                                  std::memory_order_relaxed))
+                    return;
+                while ((next = node.mNext.load(std::memory_order_acquire)) == nullptr)
+                    YieldProcessor();
+            }
+            mHead.mNext.store(next, std::memory_order_relaxed);
+            return;
+        }
+    }
+public:
+    typedef void * native_handle_type;
+    constexpr queue_mutex () noexcept : mTail(nullptr), mHead{{nullptr}} { }
+    queue_mutex (const queue_mutex&) = delete;
+    queue_mutex & operator= (const queue_mutex&) = delete;
+#if defined(MINGW_STDTHREADS_LOCK_ORDER_CHECKS)
+    ~queue_mutex (void) { detail::lock_destroyed(this); }
 #endif
-        if ((ret != kWaitObject0) && (ret != kWaitAbandoned))
+    void lock (void)
+    {
+        detail::profiled_lock(this, [this] { return try_lock_impl(); },
+                                    [this] { lock_queued(); });
+    }
+    void unlock (void)
+    {
+        detail::lock_released(this);
+        Link * next = mHead.mNext.load(std::memory_order_acquire);
+        if (next == nullptr)
         {
-            throw std::system_error(GetLastError(), std::system_category());
+            Link * expected = &mHead;
+            if (mTail.compare_exchange_strong(expected, nullptr, std::memory_order_release,
+                                              std::memory_order_relaxed))
+                return;
+            while ((next = mHead.mNext.load(std::memory_order_acquire)) == nullptr)
+                YieldProcessor();
         }
+//    The waiter may return, and its node vanish, as soon as it sees the grant.
+//  Waking an address that is no longer in use is harmless.
+        std::atomic<std::uint32_t> & state = static_cast<Node *>(next)->mState;
+        if (state.exchange(kGranted, std::memory_order_release) == kSleeping)
+            detail::wake_by_address_single(state);
+    }
+    bool try_lock (void)
+    {
+        bool ret = try_lock_impl();
+        if (ret)
+            detail::lock_acquired(this);
+        return ret;
+    }
+    native_handle_type native_handle (void)
+    {
+        return this;
+    }
+};
+
+class recursive_timed_mutex
+{
+    detail::timed_lock_word mWord;
+//    The owner is read by threads that do not hold the mutex, to decide whether
+//  they already own it. Only the owner itself can ever find its own ID here,
+//  so relaxed accesses suffice. The count is only accessed by the owner.
+    std::atomic<DWORD> mOwner;
+    DWORD mCount;
+    bool try_relock (DWORD self) noexcept
+    {
+        if (mOwner.load(std::memory_order_relaxed) != self)
+            return false;
+        ++mCount;
+        return true;
+    }
+    void set_owner (DWORD self) noexcept
+    {
+        mOwner.store(self, std::memory_order_relaxed);
+        mCount = 1;
+    }
+public:
+    typedef detail::timed_lock_word::native_handle_type native_handle_type;
+    native_handle_type native_handle() {return mWord.native_handle();}
+    recursive_timed_mutex(const recursive_timed_mutex&) = delete;
+    recursive_timed_mutex& operator=(const recursive_timed_mutex&) = delete;
+#if defined(MINGW_STDTHREADS_LOCK_ORDER_CHECKS)
+    ~recursive_timed_mutex() { detail::lock_destroyed(this); }
+#endif
+    constexpr recursive_timed_mutex() noexcept : mWord(), mOwner(0), mCount(0) {}
+    void lock()
+    {
+        DWORD self = detail::current_thread_id();
+        if (try_relock(self))
+            return;
+        detail::profiled_lock(this, [this] { return mWord.try_lock(); },
+                                    [this] { mWord.lock(); });
+        set_owner(self);
     }
     void unlock()
     {
-        if (!ReleaseMutex(mHandle))
-            throw std::system_error(GetLastError(), std::system_category());
+#if STDMUTEX_RECURSION_CHECKS
+        if (mOwner.load(std::memory_order_relaxed) != detail::current_thread_id())
+            throw std::system_error(make_error_code(std::errc::operation_not_permitted));
+#endif
+        if (--mCount != 0)
+            return;
+        mOwner.store(0, std::memory_order_relaxed);
+        detail::lock_released(this);
+        mWord.unlock();
     }
     bool try_lock()
     {
-        return try_lock_internal(0);
+        DWORD self = detail::current_thread_id();
+        if (try_relock(self))
+            return true;
+        if (!mWord.try_lock())
+            return false;
+        detail::lock_acquired(this);
+        set_owner(self);
+        return true;
     }
     template <class Rep, class Period>
     bool try_lock_for(const std::chrono::duration<Rep,Period>& dur)
     {
-        using namespace std::chrono;
-        auto timeout = duration_cast<milliseconds>(dur).count();
-        while (timeout > 0)
-        {
-          constexpr auto kMaxStep = static_cast<decltype(timeout)>(kInfinite-1);
-          auto step = (timeout < kMaxStep) ? timeout : kMaxStep;
-          if (try_lock_internal(static_cast<DWORD>(step)))
+        DWORD self = detail::current_thread_id();
+        if (try_relock(self))
             return true;
-          timeout -= step;
-        }
-        return false;
+        auto deadline = detail::deadline_after(dur);
+        if (!detail::profiled_try_lock(this, [this] { return mWord.try_lock(); },
+                [this, deadline] { return mWord.try_lock_until(deadline); }))
+            return false;
+        set_owner(self);
+        return true;
     }
     template <class Clock, class Duration>
     bool try_lock_until(const std::chrono::time_point<Clock,Duration>& timeout_time)
@@ -398,32 +1042,68 @@ public:
     }
 };
 
-//  Override if, and only if, it is necessary for error-checking.
-#if STDMUTEX_RECURSION_CHECKS
-class timed_mutex: recursive_timed_mutex
+class timed_mutex
 {
+    detail::timed_lock_word mWord;
+//  Track locking thread for error checking.
+#if STDMUTEX_RECURSION_CHECKS
+    _OwnerThread mOwnerThread {};
+#endif
 public:
-    timed_mutex() = default;
+    typedef detail::timed_lock_word::native_handle_type native_handle_type;
+    native_handle_type native_handle() {return mWord.native_handle();}
+    constexpr timed_mutex() noexcept : mWord() {}
     timed_mutex(const timed_mutex&) = delete;
     timed_mutex& operator=(const timed_mutex&) = delete;
+#if defined(MINGW_STDTHREADS_LOCK_ORDER_CHECKS)
+    ~timed_mutex() { detail::lock_destroyed(this); }
+#endif
     void lock()
     {
+#if STDMUTEX_RECURSION_CHECKS
         DWORD self = mOwnerThread.checkOwnerBeforeLock();
-        recursive_timed_mutex::lock();
+#endif
+        detail::profiled_lock(this, [this] { return mWord.try_lock(); },
+                                    [this] { mWord.lock(); });
+#if STDMUTEX_RECURSION_CHECKS
         mOwnerThread.setOwnerAfterLock(self);
+#endif
     }
     void unlock()
     {
+#if STDMUTEX_RECURSION_CHECKS
         mOwnerThread.checkSetOwnerBeforeUnlock();
-        recursive_timed_mutex::unlock();
+#endif
+        detail::lock_released(this);
+        mWord.unlock();
+    }
+    bool try_lock ()
+    {
+#if STDMUTEX_RECURSION_CHECKS
+        DWORD self = mOwnerThread.checkOwnerBeforeLock();
+#endif
+        bool ret = mWord.try_lock();
+        if (ret)
+            detail::lock_acquired(this);
+#if STDMUTEX_RECURSION_CHECKS
+        if (ret)
+            mOwnerThread.setOwnerAfterLock(self);
+#endif
+        return ret;
     }
     template <class Rep, class Period>
     bool try_lock_for(const std::chrono::duration<Rep,Period>& dur)
     {
+#if STDMUTEX_RECURSION_CHECKS
         DWORD self = mOwnerThread.checkOwnerBeforeLock();
-        bool ret = recursive_timed_mutex::try_lock_for(dur);
+#endif
+        auto deadline = detail::deadline_after(dur);
+        bool ret = detail::profiled_try_lock(this, [this] { return mWord.try_lock(); },
+            [this, deadline] { return mWord.try_lock_until(deadline); });
+#if STDMUTEX_RECURSION_CHECKS
         if (ret)
             mOwnerThread.setOwnerAfterLock(self);
+#endif
         return ret;
     }
     template <class Clock, class Duration>
@@ -431,45 +1111,111 @@ public:
     {
         return try_lock_for(timeout_time - Clock::now());
     }
-    bool try_lock ()
-    {
-        return try_lock_for(std::chrono::milliseconds(0));
-    }
 };
-#else
-typedef recursive_timed_mutex timed_mutex;
-#endif
 
+//    once_flag is a single word, so that it costs little to give each of many
+//  lazily-initialized objects a flag of its own. On Vista and Windows 7, it is
+//  the system's one-time initialization object. Elsewhere, it is a small state
+//  machine that waits through wait_on_address: natively on Windows 8 and later,
+//  and emulated on XP, where it replaces a CRITICAL_SECTION.
+//    In both cases, if the function exits by an exception, the flag returns to
+//  its initial state, and one of the waiting threads (if any) runs it again.
+#if (WINVER >= _WIN32_WINNT_VISTA) && (WINVER < _WIN32_WINNT_WIN8)
+#if !defined(INIT_ONCE_STATIC_INIT)
+#pragma message "INIT_ONCE_STATIC_INIT macro is not defined. Defining automatically."
+#define INIT_ONCE_STATIC_INIT {0}
+#endif
 class once_flag
 {
-//    When available, the SRW-based mutexes should be faster than the
-//  CriticalSection-based mutexes. Only try_lock will be unavailable in Vista,
-//  and try_lock is not used by once_flag.
-#if (_WIN32_WINNT == _WIN32_WINNT_VISTA)
-    windows7::mutex mMutex;
+    INIT_ONCE mHandle;
+    once_flag(const once_flag&) = delete;
+    once_flag& operator=(const once_flag&) = delete;
+    template<class Callable, class... Args>
+    friend void call_once(once_flag& once, Callable&& f, Args&&... args);
+public:
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wzero-as-null-pointer-constant"
+    constexpr once_flag() noexcept: mHandle(INIT_ONCE_STATIC_INIT) {}
+#pragma GCC diagnostic pop
+};
+
+template<class Callable, class... Args>
+void call_once(once_flag& flag, Callable&& func, Args&&... args)
+{
+    BOOL pending = FALSE;
+    if (!InitOnceBeginInitialize(&flag.mHandle, 0, &pending, nullptr))
+        throw std::system_error(GetLastError(), std::system_category());
+    if (!pending)
+        return;
+    try {
+        detail::invoke(std::forward<Callable>(func),std::forward<Args>(args)...);
+    } catch (...) {
+        InitOnceComplete(&flag.mHandle, INIT_ONCE_INIT_FAILED, nullptr);
+        throw;
+    }
+    InitOnceComplete(&flag.mHandle, 0, nullptr);
+}
 #else
-    mutex mMutex;
-#endif
-    std::atomic_bool mHasRun;
+class once_flag
+{
+    static constexpr std::uint32_t kIdle = 0;
+    static constexpr std::uint32_t kRunning = 1;
+    static constexpr std::uint32_t kRunningWithWaiters = 2;
+    static constexpr std::uint32_t kDone = 3;
+    std::atomic<std::uint32_t> mState;
     once_flag(const once_flag&) = delete;
     once_flag& operator=(const once_flag&) = delete;
     template<class Callable, class... Args>
     friend void call_once(once_flag& once, Callable&& f, Args&&... args);
+//    Returns true if the caller must run the function, or false once another
+//  thread has run it to completion.
+    bool begin (void) noexcept
+    {
+        std::uint32_t state = mState.load(std::memory_order_acquire);
+        for (;;)
+        {
+            if (state == kDone)
+                return false;
+            if (state == kIdle)
+            {
+                if (mState.compare_exchange_weak(state, kRunning, std::memory_order_acquire))
+                    return true;
+                continue;
+            }
+            if ((state == kRunning) &&
+                !mState.compare_exchange_weak(state, kRunningWithWaiters,
+                                              std::memory_order_acquire))
+                continue;
+            detail::wait_on_address(mState, kRunningWithWaiters,
+                                    detail::kAddressWaitInfinite);
+            state = mState.load(std::memory_order_acquire);
+        }
+    }
+    void end (std::uint32_t state) noexcept
+    {
+        if (mState.exchange(state, std::memory_order_release) == kRunningWithWaiters)
+            detail::wake_by_address_all(mState);
+    }
 public:
-    constexpr once_flag() noexcept: mMutex(), mHasRun(false) {}
+    constexpr once_flag() noexcept: mState(kIdle) {}
 };
 
 template<class Callable, class... Args>
 void call_once(once_flag& flag, Callable&& func, Args&&... args)
 {
-    if (flag.mHasRun.load(std::memory_order_acquire))
+    if (flag.mState.load(std::memory_order_acquire) == once_flag::kDone)
         return;
-    lock_guard<decltype(flag.mMutex)> lock(flag.mMutex);
-    if (flag.mHasRun.load(std::memory_order_relaxed))
+    if (!flag.begin())
         return;
-    detail::invoke(std::forward<Callable>(func),std::forward<Args>(args)...);
-    flag.mHasRun.store(true, std::memory_order_release);
+    try {
+        detail::invoke(std::forward<Callable>(func),std::forward<Args>(args)...);
+    } catch (...) {
+        flag.end(once_flag::kIdle);
+        throw;
+    }
+    flag.end(once_flag::kDone);
 }
+#endif
 } //  Namespace mingw_stdthread
 
 //  Push objects into std, but only if they are not already there.
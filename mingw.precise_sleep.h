@@ -0,0 +1,142 @@
+/// \file mingw.precise_sleep.h
+/// \brief Deadlines, and sleeping until them with better than millisecond
+///   precision. Used internally by the other headers of this library.
+///
+/// (c) 2013-2016 by Mega Limited, Auckland, New Zealand
+///
+/// \copyright Simplified (2-clause) BSD License.
+///
+/// \note This file may become part of the mingw-w64 runtime package. If/when
+/// this happens, the appropriate license will be added, i.e. this code will
+/// become dual-licensed, and the current BSD 2-clause license will stay.
+
+//    Timeouts passed to Windows are whole milliseconds, and usually expire on
+//  the next tick of the system timer, 15.6 ms by default. A sleep of one
+//  millisecond therefore often lasts fifteen, and a sleep of less than a
+//  millisecond cannot be requested at all.
+//    Windows 10, version 1803, added high-resolution waitable timers, which
+//  expire within microseconds of their due time. Each thread creates one such
+//  timer the first time it needs it, keeps it until it exits, and sleeps on it.
+//  Where no such timer can be created, the thread sleeps in whole milliseconds
+//  while at least one remains, and yields its processor for the rest.
+//    Waking from either takes some microseconds. Define
+//  MINGW_STDTHREADS_SLEEP_SPIN_US to a number of microseconds to end each sleep
+//  that much early, and spin for the rest, trading processor time for
+//  precision.
+
+#ifndef MINGW_PRECISE_SLEEP_H_
+#define MINGW_PRECISE_SLEEP_H_
+
+#if !defined(__cplusplus) || (__cplusplus < 201103L)
+#error A C++11 compiler is required!
+#endif
+
+#include <chrono>
+#include <ratio>
+
+#include <sdkddkver.h>  //  Detect Windows version.
+#if (defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
+#include <windows.h>    //  No further granularity can be expected.
+#else
+#include <synchapi.h>   //  For Sleep and the waitable timers
+#include <handleapi.h>  //  For CloseHandle
+#endif
+
+#if !defined(MINGW_STDTHREADS_SLEEP_SPIN_US)
+#define MINGW_STDTHREADS_SLEEP_SPIN_US 0
+#endif
+
+namespace mingw_stdthread
+{
+namespace detail
+{
+//    Converts a relative timeout into a deadline on the steady clock. The
+//  conversion rounds up, so that a wait never ends early, and saturates, so
+//  that very long timeouts (such as duration::max()) do not overflow.
+template<class Rep, class Period>
+std::chrono::steady_clock::time_point
+    deadline_after (const std::chrono::duration<Rep, Period> & rel_time)
+{
+    using namespace std::chrono;
+    using clock = steady_clock;
+    auto now = clock::now();
+    if (rel_time <= rel_time.zero())
+        return now;
+    if (duration<double>(rel_time) >= duration<double>(clock::time_point::max() - now))
+        return clock::time_point::max();
+    auto step = duration_cast<clock::duration>(rel_time);
+    if (step < rel_time)
+        ++step;
+    return now + step;
+}
+
+#if (WINVER >= _WIN32_WINNT_VISTA)
+//  CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, which older headers do not define.
+constexpr DWORD kHighResolutionTimer = 0x00000002;
+
+//    Returns this thread's high-resolution timer, or nullptr if the system
+//  cannot provide one, in which case the thread does not ask again.
+inline HANDLE high_resolution_timer (void) noexcept
+{
+    struct ThreadTimer
+    {
+        HANDLE mHandle;
+        ThreadTimer (void) noexcept
+            : mHandle(CreateWaitableTimerExW(nullptr, nullptr, kHighResolutionTimer,
+                                             TIMER_ALL_ACCESS))
+        {
+        }
+        ~ThreadTimer (void)
+        {
+            if (mHandle != nullptr)
+                CloseHandle(mHandle);
+        }
+    };
+    static thread_local ThreadTimer timer;
+    return timer.mHandle;
+}
+#endif
+
+//  Sleeps until the steady clock reaches `deadline`.
+inline void sleep_precisely_until (std::chrono::steady_clock::time_point deadline) noexcept
+{
+    using namespace std::chrono;
+    constexpr microseconds kSpin (MINGW_STDTHREADS_SLEEP_SPIN_US);
+    constexpr DWORD kInfinite = 0xffffffffl;
+    constexpr DWORD kMaxSleep = kInfinite - 1;
+#if (WINVER >= _WIN32_WINNT_VISTA)
+    HANDLE timer = high_resolution_timer();
+#endif
+    for (;;)
+    {
+        auto remaining = deadline - steady_clock::now();
+        if (remaining <= kSpin)
+            break;
+        remaining -= kSpin;
+#if (WINVER >= _WIN32_WINNT_VISTA)
+        if (timer != nullptr)
+        {
+//  A negative due time is relative, in units of 100 ns. Round up.
+            using ticks = duration<long long, std::ratio<1, 10000000> >;
+            auto due = duration_cast<ticks>(remaining);
+            if (due < remaining)
+                ++due;
+            LARGE_INTEGER relative;
+            relative.QuadPart = -due.count();
+            if (SetWaitableTimer(timer, &relative, 0, nullptr, nullptr, FALSE))
+            {
+                WaitForSingleObject(timer, kInfinite);
+                continue;
+            }
+        }
+#endif
+//  Round down, so as not to overshoot by a tick; the loop sleeps again.
+        auto ms = duration_cast<milliseconds>(remaining).count();
+        Sleep((ms < kMaxSleep) ? static_cast<DWORD>(ms) : kMaxSleep);
+    }
+    while (steady_clock::now() < deadline)
+        YieldProcessor();
+}
+} //  Namespace "detail"
+} //  Namespace "mingw_stdthread"
+#endif // MINGW_PRECISE_SLEEP_H_
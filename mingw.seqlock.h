@@ -0,0 +1,194 @@
+/// \file mingw.seqlock.h
+/// \brief A sequence lock, for small values that are read far more often than
+///   written, and whose readers must not slow each other down.
+///
+/// (c) 2013-2016 by Mega Limited, Auckland, New Zealand
+///
+/// \copyright Simplified (2-clause) BSD License.
+///
+/// \note This file may become part of the mingw-w64 runtime package. If/when
+/// this happens, the appropriate license will be added, i.e. this code will
+/// become dual-licensed, and the current BSD 2-clause license will stay.
+
+//    Every reader of a shared mutex writes to the mutex, so the cache line that
+//  holds it moves between processors on every read. Readers of a sequence lock
+//  only read: they note an even sequence number, copy the data, and check that
+//  the number has not changed in the meantime. A writer makes the number odd
+//  while it changes the data, so a reader that overlaps a write retries.
+//  Writers are serialized by a mutex.
+//    Readers copy the data while a writer may be changing it. To keep that copy
+//  free of data races, seqlock<T> stores the value as an array of atomic words,
+//  which are read and written with relaxed operations, and ordered by fences
+//  around the sequence number. T must therefore be trivially copyable. Readers
+//  spin while a writer copies its value in, so T should be small.
+
+#ifndef MINGW_SEQLOCK_H_
+#define MINGW_SEQLOCK_H_
+
+#if !defined(__cplusplus) || (__cplusplus < 201103L)
+#error A C++11 compiler is required!
+#endif
+
+#include <atomic>
+#include <cstddef>          //  For std::size_t
+#include <cstdint>          //  For std::uintptr_t
+#include <cstring>          //  For std::memcpy
+#include <type_traits>
+
+#include "mingw.mutex.h"
+
+namespace mingw_stdthread
+{
+template<class T = void>
+class seqlock;
+
+//    The bare sequence lock, for data that the caller protects itself. Readers
+//  loop:
+//      unsigned seq;
+//      do {
+//          seq = lock.read_begin();
+//          ...copy the data, using relaxed atomic loads...
+//      } while (lock.read_retry(seq));
+//  Writers use lock and unlock, directly or through lock_guard.
+template<>
+class seqlock<void>
+{
+    static constexpr unsigned kSpinLimit = 64;
+    std::atomic<unsigned> mSequence;
+    mutex mMutex;
+public:
+    seqlock (void) : mSequence(0), mMutex() { }
+    seqlock (const seqlock&) = delete;
+    seqlock & operator= (const seqlock&) = delete;
+
+//  Waits until no write is in progress, and returns the sequence number.
+    unsigned read_begin (void) const noexcept
+    {
+        unsigned seq;
+        for (unsigned spins = 0; (seq = mSequence.load(std::memory_order_acquire)) & 1; ++spins)
+        {
+            if (spins < kSpinLimit)
+                YieldProcessor();
+            else
+                SwitchToThread();
+        }
+        return seq;
+    }
+//  True if a write has begun since read_begin returned `seq`.
+    bool read_retry (unsigned seq) const noexcept
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return mSequence.load(std::memory_order_relaxed) != seq;
+    }
+
+    void lock (void)
+    {
+        mMutex.lock();
+        begin_write();
+    }
+    bool try_lock (void)
+    {
+        if (!mMutex.try_lock())
+            return false;
+        begin_write();
+        return true;
+    }
+    void unlock (void)
+    {
+        end_write();
+        mMutex.unlock();
+    }
+private:
+//    seqlock<T> holds the mutex while it prepares a new value, and only makes
+//  readers wait while it copies the value in.
+    template<class>
+    friend class seqlock;
+//  The data must not be changed before readers can see the odd number.
+    void begin_write (void) noexcept
+    {
+        mSequence.store(mSequence.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+    void end_write (void) noexcept
+    {
+        mSequence.store(mSequence.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_release);
+    }
+};
+
+//  Holds a value of type T, which readers copy out and writers replace.
+template<class T>
+class seqlock
+{
+#if !defined(__GNUC__) || (__GNUC__ >= 5)
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "seqlock requires a trivially copyable type.");
+#endif
+    typedef std::uintptr_t word_type;
+    static constexpr std::size_t kWords = (sizeof(T) + sizeof(word_type) - 1) / sizeof(word_type);
+    seqlock<void> mLock;
+    std::atomic<word_type> mWords [kWords];
+
+    T read_words (void) const noexcept
+    {
+        word_type words [kWords];
+        for (std::size_t i = 0; i < kWords; ++i)
+            words[i] = mWords[i].load(std::memory_order_relaxed);
+        T value;
+        std::memcpy(&value, words, sizeof(T));
+        return value;
+    }
+    void write_words (T const & value) noexcept
+    {
+        word_type words [kWords] = {};
+        std::memcpy(words, &value, sizeof(T));
+        mLock.begin_write();
+        for (std::size_t i = 0; i < kWords; ++i)
+            mWords[i].store(words[i], std::memory_order_relaxed);
+        mLock.end_write();
+    }
+public:
+    typedef T value_type;
+
+    seqlock (void) : seqlock(T()) { }
+    explicit seqlock (T const & value) : mLock()
+    {
+        write_words(value);
+    }
+    seqlock (const seqlock&) = delete;
+    seqlock & operator= (const seqlock&) = delete;
+
+//  Returns a copy of the value, as it was between two writes.
+    T load (void) const noexcept
+    {
+        unsigned seq;
+        T value;
+        do
+        {
+            seq = mLock.read_begin();
+            value = read_words();
+        }
+        while (mLock.read_retry(seq));
+        return value;
+    }
+    void store (T const & value)
+    {
+        lock_guard<mutex> guard (mLock.mMutex);
+        write_words(value);
+    }
+//    Applies `fn` to a copy of the value, in place, and stores the result,
+//  which it also returns. Other writers wait until it is done; readers keep
+//  seeing the old value while `fn` runs, and the new value after.
+    template<class Fn>
+    T update (Fn fn)
+    {
+        lock_guard<mutex> guard (mLock.mMutex);
+        T value = read_words();
+        fn(value);
+        write_words(value);
+        return value;
+    }
+};
+} //  Namespace "mingw_stdthread"
+#endif // MINGW_SEQLOCK_H_
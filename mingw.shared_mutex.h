@@ -40,6 +40,8 @@
 //  For timing in shared_lock and shared_timed_mutex.
 #include <chrono>
 #include <limits>
+#include <cstddef>  //  For std::size_t
+#include <cstdint>  //  For std::uint32_t
 
 //    Use MinGW's shared_lock class template, if it's available. Requires C++14.
 //  If unavailable (eg. because this library is being used in C++11), then an
@@ -71,11 +73,24 @@ namespace mingw_stdthread
 //  Define a portable atomics-based shared_mutex
 namespace portable
 {
+//    A shared mutex in a single 32-bit word: a count of readers, a bit that a
+//  writer sets when it holds, or is waiting for the readers to release, the
+//  mutex, and a bit that marks threads sleeping on the word. Writers take
+//  precedence: once a writer has set its bit, new readers wait until it is
+//  done, so a steady stream of readers cannot starve it.
+//    A blocked thread spins for a short while, then sleeps on the word through
+//  wait_on_address, until the mutex is released or its deadline passes. Any
+//  change that may let sleeping threads proceed (a writer unlocking, or the
+//  last reader leaving) clears the sleeping bit, and wakes them all; those that
+//  still cannot proceed set it again.
 class shared_mutex
 {
-    typedef uint_fast16_t counter_type;
+    typedef std::uint32_t counter_type;
+    static constexpr counter_type kWriteBit = counter_type(1) << 31;
+    static constexpr counter_type kWaitBit = counter_type(1) << 30;
+    static constexpr counter_type kReaderMask = kWaitBit - 1;
+    static constexpr unsigned kSpinLimit = 128;
     std::atomic<counter_type> mCounter {0};
-    static constexpr counter_type kWriteBit = 1 << (std::numeric_limits<counter_type>::digits - 1);
 
 #if STDMUTEX_RECURSION_CHECKS
 //  Runtime checker for verifying owner threads. Note: Exclusive mode only.
@@ -93,103 +108,1015 @@ public:
     ~shared_mutex ()
     {
 //  Terminate if someone tries to destroy an owned mutex.
-        assert(mCounter.load(std::memory_order_relaxed) == 0);
+        assert((mCounter.load(std::memory_order_relaxed) & ~kWaitBit) == 0);
+        detail::lock_destroyed(this);
     }
 
     void lock_shared (void)
+    {
+        detail::profiled_lock(this, [this] { return try_lock_shared_impl(); },
+            [this] { try_lock_shared_until_impl(time_point::max()); });
+    }
+
+    bool try_lock_shared (void)
+    {
+        bool ret = try_lock_shared_impl();
+        if (ret)
+            detail::lock_acquired(this);
+        return ret;
+    }
+
+    template<class Rep, class Period>
+    bool try_lock_shared_for (const std::chrono::duration<Rep,Period>& rel_time)
+    {
+        auto deadline = detail::deadline_after(rel_time);
+        return detail::profiled_try_lock(this, [this] { return try_lock_shared_impl(); },
+            [this, deadline] { return try_lock_shared_until_impl(deadline); });
+    }
+
+    template<class Clock, class Duration>
+    bool try_lock_shared_until (const std::chrono::time_point<Clock,Duration>& cutoff)
+    {
+        return try_lock_shared_for(cutoff - Clock::now());
+    }
+
+    void unlock_shared (void)
+    {
+        using namespace std;
+        detail::lock_released(this);
+        counter_type expected = mCounter.load(memory_order_relaxed);
+        counter_type desired;
+        do
+        {
+#ifndef NDEBUG
+            if (!(expected & kReaderMask))
+                throw system_error(make_error_code(errc::operation_not_permitted));
+#endif
+            desired = expected - 1;
+//  The last reader lets a waiting writer in.
+            if (!(desired & kReaderMask))
+                desired &= ~kWaitBit;
+        }
+        while (!mCounter.compare_exchange_weak(expected, desired, memory_order_release,
+                                               memory_order_relaxed));
+        if ((expected ^ desired) & kWaitBit)
+            detail::wake_by_address_all(mCounter);
+    }
+
+//  Behavior is undefined if a lock was previously acquired.
+    void lock (void)
+    {
+#if STDMUTEX_RECURSION_CHECKS
+        DWORD self = mOwnerThread.checkOwnerBeforeLock();
+#endif
+        detail::profiled_lock(this, [this] { return try_lock_impl(); },
+            [this] { try_lock_until_impl(time_point::max()); });
+#if STDMUTEX_RECURSION_CHECKS
+        mOwnerThread.setOwnerAfterLock(self);
+#endif
+    }
+
+    bool try_lock (void)
+    {
+#if STDMUTEX_RECURSION_CHECKS
+        DWORD self = mOwnerThread.checkOwnerBeforeLock();
+#endif
+        bool ret = try_lock_impl();
+        if (ret)
+            detail::lock_acquired(this);
+#if STDMUTEX_RECURSION_CHECKS
+        if (ret)
+            mOwnerThread.setOwnerAfterLock(self);
+#endif
+        return ret;
+    }
+
+    template<class Rep, class Period>
+    bool try_lock_for (const std::chrono::duration<Rep,Period>& rel_time)
+    {
+#if STDMUTEX_RECURSION_CHECKS
+        DWORD self = mOwnerThread.checkOwnerBeforeLock();
+#endif
+        auto deadline = detail::deadline_after(rel_time);
+        bool ret = detail::profiled_try_lock(this, [this] { return try_lock_impl(); },
+            [this, deadline] { return try_lock_until_impl(deadline); });
+#if STDMUTEX_RECURSION_CHECKS
+        if (ret)
+            mOwnerThread.setOwnerAfterLock(self);
+#endif
+        return ret;
+    }
+
+    template<class Clock, class Duration>
+    bool try_lock_until (const std::chrono::time_point<Clock,Duration>& cutoff)
+    {
+        return try_lock_for(cutoff - Clock::now());
+    }
+
+    void unlock (void)
+    {
+#if STDMUTEX_RECURSION_CHECKS
+        mOwnerThread.checkSetOwnerBeforeUnlock();
+#endif
+        using namespace std;
+        detail::lock_released(this);
+#ifndef NDEBUG
+        if ((mCounter.load(memory_order_relaxed) & ~kWaitBit) != kWriteBit)
+            throw system_error(make_error_code(errc::operation_not_permitted));
+#endif
+        if (mCounter.exchange(0, memory_order_release) & kWaitBit)
+            detail::wake_by_address_all(mCounter);
+    }
+
+    native_handle_type native_handle (void)
+    {
+        return this;
+    }
+private:
+    typedef std::chrono::steady_clock::time_point time_point;
+
+//    Waits until none of the bits in `mask` are set, or until the deadline
+//  passes. On success, `state` holds the value in which they were found clear.
+    bool wait_for_clear (counter_type mask, counter_type & state, time_point deadline)
+    {
+        state = mCounter.load(std::memory_order_acquire);
+        for (unsigned spins = 0; state & mask; state = mCounter.load(std::memory_order_acquire))
+        {
+            if (spins < kSpinLimit)
+            {
+                ++spins;
+                YieldProcessor();
+                continue;
+            }
+            if (!(state & kWaitBit) &&
+                !mCounter.compare_exchange_weak(state, state | kWaitBit,
+                                                std::memory_order_relaxed))
+                continue;
+            if (!detail::wait_on_address_until(mCounter, state | kWaitBit, deadline))
+                return false;
+        }
+        return true;
+    }
+
+    bool try_lock_shared_until_impl (time_point deadline)
+    {
+        counter_type expected;
+        do
+        {
+            if (!wait_for_clear(kWriteBit, expected, deadline))
+                return false;
+        }
+        while (!mCounter.compare_exchange_weak(expected, expected + 1,
+                                               std::memory_order_acquire,
+                                               std::memory_order_relaxed));
+        return true;
+    }
+
+    bool try_lock_shared_impl (void)
     {
         counter_type expected = mCounter.load(std::memory_order_relaxed);
+        while (!(expected & kWriteBit))
+            if (mCounter.compare_exchange_weak(expected, expected + 1,
+                                               std::memory_order_acquire,
+                                               std::memory_order_relaxed))
+                return true;
+        return false;
+    }
+
+//    Claim the write bit first, which keeps new readers out, and then wait for
+//  the current readers to finish up. A writer that gives up lets blocked
+//  readers back in.
+    bool try_lock_until_impl (time_point deadline)
+    {
+        counter_type expected;
         do
         {
-//  Delay if writing or if too many readers are attempting to read.
-            if (expected >= kWriteBit - 1)
-            {
-                using namespace std;
-                expected = mCounter.load(std::memory_order_relaxed);
-                continue;
-            }
-            if (mCounter.compare_exchange_weak(expected,
-                                               static_cast<counter_type>(expected + 1),
-                                               std::memory_order_acquire,
-                                               std::memory_order_relaxed))
-                break;
+            if (!wait_for_clear(kWriteBit, expected, deadline))
+                return false;
+        }
+        while (!mCounter.compare_exchange_weak(expected, expected | kWriteBit,
+                                               std::memory_order_acquire,
+                                               std::memory_order_relaxed));
+        if (wait_for_clear(kReaderMask, expected, deadline))
+            return true;
+        if (mCounter.fetch_and(~(kWriteBit | kWaitBit), std::memory_order_relaxed) & kWaitBit)
+            detail::wake_by_address_all(mCounter);
+        return false;
+    }
+
+    bool try_lock_impl (void)
+    {
+        counter_type expected = mCounter.load(std::memory_order_relaxed);
+        return !(expected & ~kWaitBit) &&
+               mCounter.compare_exchange_strong(expected, expected | kWriteBit,
+                                                std::memory_order_acquire,
+                                                std::memory_order_relaxed);
+    }
+};
+
+} //  Namespace portable
+
+//    The native shared_mutex implementation primarily uses features of Windows
+//  Vista, but the features used for try_lock and try_lock_shared were not
+//  introduced until Windows 7. To allow limited use while compiling for Vista,
+//  I define the class without try_* functions in that case.
+//    Only fully-featured implementations will be placed into namespace std.
+#if defined(_WIN32) && (WINVER >= _WIN32_WINNT_VISTA)
+namespace vista
+{
+class condition_variable_any;
+}
+
+namespace windows7
+{
+//  We already #include "mingw.mutex.h". May as well reduce redundancy.
+class shared_mutex : windows7::mutex
+{
+//    Allow condition_variable_any (and only condition_variable_any) to treat a
+//  shared_mutex as its base class.
+    friend class vista::condition_variable_any;
+public:
+    using windows7::mutex::native_handle_type;
+    using windows7::mutex::lock;
+    using windows7::mutex::unlock;
+    using windows7::mutex::native_handle;
+
+    void lock_shared (void)
+    {
+#if (WINVER >= _WIN32_WINNT_WIN7)
+        detail::profiled_lock(this,
+            [this] { return TryAcquireSRWLockShared(native_handle()) != 0; },
+            [this] { AcquireSRWLockShared(native_handle()); });
+#else
+        detail::profiled_lock(this, [this] { AcquireSRWLockShared(native_handle()); });
+#endif
+    }
+
+    void unlock_shared (void)
+    {
+        detail::lock_released(this);
+        ReleaseSRWLockShared(native_handle());
+    }
+
+//  TryAcquireSRW functions are a Windows 7 feature.
+#if (WINVER >= _WIN32_WINNT_WIN7)
+    bool try_lock_shared (void)
+    {
+        bool ret = TryAcquireSRWLockShared(native_handle()) != 0;
+        if (ret)
+            detail::lock_acquired(this);
+        return ret;
+    }
+
+    using windows7::mutex::try_lock;
+#endif
+};
+
+} //  Namespace windows7
+#endif  //  Compiling for Vista
+#if (defined(_WIN32) && (WINVER >= _WIN32_WINNT_WIN7))
+using windows7::shared_mutex;
+#else
+using portable::shared_mutex;
+#endif
+
+//    Slim Reader-Writer locks cannot be acquired with a timeout, so, as with
+//  timed_mutex, the timed version is built on a word that threads can wait on
+//  until a deadline, on every version of Windows.
+class shared_timed_mutex : portable::shared_mutex
+{
+    typedef portable::shared_mutex Base;
+public:
+    using Base::native_handle_type;
+    using Base::lock;
+    using Base::try_lock;
+    using Base::try_lock_for;
+    using Base::try_lock_until;
+    using Base::unlock;
+    using Base::lock_shared;
+    using Base::try_lock_shared;
+    using Base::try_lock_shared_for;
+    using Base::try_lock_shared_until;
+    using Base::unlock_shared;
+    using Base::native_handle;
+};
+
+//    A reader-writer lock for data that is read far more often than written,
+//  also known as a big-reader lock. Every reader of an ordinary shared_mutex
+//  modifies the same word, so its cache line moves between processors even
+//  when no writer is present, and read throughput stops growing after a few
+//  cores. Here, each reader counts itself in one of kSlots counters, selected
+//  by its thread ID and padded to a cache line, so readers on different slots
+//  share no written memory. A writer pays instead: it announces itself, then
+//  waits for every slot to drain.
+//    Writers take precedence: once a writer has announced itself, new readers
+//  wait until it is done. The counters and the announcement are ordered by
+//  sequentially-consistent operations, as in Dekker's algorithm: a reader
+//  counts itself before checking for a writer, and a writer announces itself
+//  before checking the counters, so at least one of the two sees the other.
+//    Each instance takes kSlots cache lines. Waiting goes through
+//  wait_on_address, so this mutex is available on every supported version of
+//  Windows.
+class distributed_shared_mutex
+{
+    static constexpr unsigned kSlotBits = 6;
+    static constexpr std::size_t kSlots = std::size_t(1) << kSlotBits;
+    struct alignas(64) Slot
+    {
+        std::atomic<std::uint32_t> mReaders;
+    };
+    Slot mSlots [kSlots];
+//    Serializes writers, and supports their timed waits. Only the writer that
+//  holds it changes mWriter.
+    detail::timed_lock_word mWriterLock;
+//  1 while a writer holds, or is waiting to acquire, the mutex.
+    std::atomic<std::uint32_t> mWriter;
+#if STDMUTEX_RECURSION_CHECKS
+//  Runtime checker for verifying owner threads. Note: Exclusive mode only.
+    _OwnerThread mOwnerThread {};
+#endif
+
+    Slot & my_slot (void) noexcept
+    {
+        std::uint32_t id = detail::current_thread_id() >> 2;
+        return mSlots[static_cast<std::uint32_t>(id * 0x9E3779B9u) >> (32 - kSlotBits)];
+    }
+//  The last reader to leave a slot wakes a writer that waits for it.
+    void leave (Slot & slot) noexcept
+    {
+        if ((slot.mReaders.fetch_sub(1, std::memory_order_seq_cst) == 1) &&
+            mWriter.load(std::memory_order_seq_cst))
+            detail::wake_by_address_all(slot.mReaders);
+    }
+    bool try_enter (Slot & slot) noexcept
+    {
+        slot.mReaders.fetch_add(1, std::memory_order_seq_cst);
+        if (!mWriter.load(std::memory_order_seq_cst))
+            return true;
+        leave(slot);
+        return false;
+    }
+    bool try_lock_shared_until_impl (std::chrono::steady_clock::time_point deadline) noexcept
+    {
+        Slot & slot = my_slot();
+        while (!try_enter(slot))
+        {
+            while (mWriter.load(std::memory_order_relaxed))
+                if (!detail::wait_on_address_until(mWriter, 1, deadline))
+                    return false;
+        }
+        return true;
+    }
+//    Called with mWriterLock held. On failure, withdraws the announcement and
+//  lets blocked readers in.
+    bool drain_until (std::chrono::steady_clock::time_point deadline) noexcept
+    {
+        mWriter.store(1, std::memory_order_seq_cst);
+        for (Slot & slot : mSlots)
+        {
+            std::uint32_t readers;
+            while ((readers = slot.mReaders.load(std::memory_order_seq_cst)) != 0)
+            {
+                if (!detail::wait_on_address_until(slot.mReaders, readers, deadline))
+                {
+                    release_writers();
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+    void release_writers (void) noexcept
+    {
+        mWriter.store(0, std::memory_order_seq_cst);
+        detail::wake_by_address_all(mWriter);
+        mWriterLock.unlock();
+    }
+    bool try_lock_until_impl (std::chrono::steady_clock::time_point deadline) noexcept
+    {
+        return mWriterLock.try_lock_until(deadline) && drain_until(deadline);
+    }
+    bool try_lock_impl (void) noexcept
+    {
+        return mWriterLock.try_lock() &&
+               drain_until(std::chrono::steady_clock::time_point::min());
+    }
+public:
+    typedef distributed_shared_mutex * native_handle_type;
+
+    constexpr distributed_shared_mutex () noexcept : mSlots(), mWriterLock(), mWriter(0) { }
+    distributed_shared_mutex (const distributed_shared_mutex&) = delete;
+    distributed_shared_mutex & operator= (const distributed_shared_mutex&) = delete;
+#if defined(MINGW_STDTHREADS_LOCK_ORDER_CHECKS)
+    ~distributed_shared_mutex (void) { detail::lock_destroyed(this); }
+#endif
+
+    void lock_shared (void)
+    {
+        detail::profiled_lock(this, [this] { return try_enter(my_slot()); },
+            [this] { try_lock_shared_until_impl(std::chrono::steady_clock::time_point::max()); });
+    }
+    bool try_lock_shared (void)
+    {
+        bool ret = try_enter(my_slot());
+        if (ret)
+            detail::lock_acquired(this);
+        return ret;
+    }
+    template<class Rep, class Period>
+    bool try_lock_shared_for (const std::chrono::duration<Rep,Period>& rel_time)
+    {
+        auto deadline = detail::deadline_after(rel_time);
+        return detail::profiled_try_lock(this, [this] { return try_enter(my_slot()); },
+            [this, deadline] { return try_lock_shared_until_impl(deadline); });
+    }
+    template<class Clock, class Duration>
+    bool try_lock_shared_until (const std::chrono::time_point<Clock,Duration>& cutoff)
+    {
+        return try_lock_shared_for(cutoff - Clock::now());
+    }
+    void unlock_shared (void)
+    {
+        detail::lock_released(this);
+        leave(my_slot());
+    }
+
+    void lock (void)
+    {
+#if STDMUTEX_RECURSION_CHECKS
+        DWORD self = mOwnerThread.checkOwnerBeforeLock();
+#endif
+        detail::profiled_lock(this, [this] { return try_lock_impl(); },
+            [this] { try_lock_until_impl(std::chrono::steady_clock::time_point::max()); });
+#if STDMUTEX_RECURSION_CHECKS
+        mOwnerThread.setOwnerAfterLock(self);
+#endif
+    }
+    bool try_lock (void)
+    {
+#if STDMUTEX_RECURSION_CHECKS
+        DWORD self = mOwnerThread.checkOwnerBeforeLock();
+#endif
+        bool ret = try_lock_impl();
+        if (ret)
+            detail::lock_acquired(this);
+#if STDMUTEX_RECURSION_CHECKS
+        if (ret)
+            mOwnerThread.setOwnerAfterLock(self);
+#endif
+        return ret;
+    }
+    template<class Rep, class Period>
+    bool try_lock_for (const std::chrono::duration<Rep,Period>& rel_time)
+    {
+#if STDMUTEX_RECURSION_CHECKS
+        DWORD self = mOwnerThread.checkOwnerBeforeLock();
+#endif
+        auto deadline = detail::deadline_after(rel_time);
+        bool ret = detail::profiled_try_lock(this, [this] { return try_lock_impl(); },
+            [this, deadline] { return try_lock_until_impl(deadline); });
+#if STDMUTEX_RECURSION_CHECKS
+        if (ret)
+            mOwnerThread.setOwnerAfterLock(self);
+#endif
+        return ret;
+    }
+    template<class Clock, class Duration>
+    bool try_lock_until (const std::chrono::time_point<Clock,Duration>& cutoff)
+    {
+        return try_lock_for(cutoff - Clock::now());
+    }
+    void unlock (void)
+    {
+#if STDMUTEX_RECURSION_CHECKS
+        mOwnerThread.checkSetOwnerBeforeUnlock();
+#endif
+        detail::lock_released(this);
+        release_writers();
+    }
+
+    native_handle_type native_handle (void)
+    {
+        return this;
+    }
+};
+
+//    A shared mutex with a third, upgradeable, mode, for code that reads, and
+//  then writes only if what it read calls for it. A thread with upgrade
+//  ownership shares the mutex with readers, but excludes writers and other
+//  upgrading threads, so it can turn its ownership into exclusive ownership
+//  without letting a writer in between, and without checking its data again.
+//  Exclusive ownership can likewise be turned back into shared or upgrade
+//  ownership without letting a writer in.
+//    The state is one word: a count of readers (including an upgrading owner),
+//  a writer bit, and a bit that marks readers waiting. Writers and upgrading
+//  owners are serialized by a second word, so at most one of them is active at
+//  a time. A writer sets the writer bit as soon as it holds that word, which
+//  keeps new readers out while the current ones drain; writers therefore take
+//  precedence over readers. Waiting goes through wait_on_address, so this mutex
+//  is available on every supported version of Windows.
+class upgrade_mutex
+{
+    static constexpr std::uint32_t kWriter = std::uint32_t(1) << 31;
+    static constexpr std::uint32_t kReadersWaiting = std::uint32_t(1) << 30;
+    static constexpr std::uint32_t kReaderMask = kReadersWaiting - 1;
+    std::atomic<std::uint32_t> mState;
+//  Held by the writer, or by the upgrading owner.
+    detail::timed_lock_word mGate;
+
+#if STDMUTEX_RECURSION_CHECKS
+//  Runtime checker for verifying owner threads. Note: Exclusive mode only.
+    _OwnerThread mOwnerThread {};
+#endif
+
+    typedef std::chrono::steady_clock::time_point time_point;
+
+    bool try_lock_shared_impl (void) noexcept
+    {
+        std::uint32_t state = mState.load(std::memory_order_relaxed);
+        while (!(state & kWriter))
+            if (mState.compare_exchange_weak(state, state + 1, std::memory_order_acquire,
+                                             std::memory_order_relaxed))
+                return true;
+        return false;
+    }
+    bool try_lock_shared_until_impl (time_point deadline) noexcept
+    {
+        std::uint32_t state = mState.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            if (!(state & kWriter))
+            {
+                if (mState.compare_exchange_weak(state, state + 1, std::memory_order_acquire,
+                                                 std::memory_order_relaxed))
+                    return true;
+                continue;
+            }
+            if (!(state & kReadersWaiting) &&
+                !mState.compare_exchange_weak(state, state | kReadersWaiting,
+                                              std::memory_order_relaxed))
+                continue;
+            if (!detail::wait_on_address_until(mState, state | kReadersWaiting, deadline))
+                return false;
+            state = mState.load(std::memory_order_relaxed);
+        }
+    }
+//    Called with mGate held and the writer bit set. Waits until the readers
+//  have left; on timeout, lets them back in.
+    bool drain_until (time_point deadline) noexcept
+    {
+        std::uint32_t state;
+        while ((state = mState.load(std::memory_order_acquire)) & kReaderMask)
+        {
+            if (!detail::wait_on_address_until(mState, state, deadline))
+            {
+                release_writer(0);
+                return false;
+            }
+        }
+        return true;
+    }
+//    Replaces the writer bit with `readers` readers, and wakes the readers that
+//  waited for the writer.
+    void release_writer (std::uint32_t readers) noexcept
+    {
+        std::uint32_t state = mState.load(std::memory_order_relaxed);
+        while (!mState.compare_exchange_weak(state, (state & kReaderMask) + readers,
+                                             std::memory_order_release,
+                                             std::memory_order_relaxed));
+        if (state & kReadersWaiting)
+            detail::wake_by_address_all(mState);
+    }
+    bool try_lock_until_impl (time_point deadline) noexcept
+    {
+        if (!mGate.try_lock_until(deadline))
+            return false;
+        mState.fetch_or(kWriter, std::memory_order_acquire);
+        if (drain_until(deadline))
+            return true;
+        mGate.unlock();
+        return false;
+    }
+    bool try_lock_impl (void) noexcept
+    {
+        if (!mGate.try_lock())
+            return false;
+        std::uint32_t state = 0;
+        if (mState.compare_exchange_strong(state, kWriter, std::memory_order_acquire,
+                                           std::memory_order_relaxed))
+            return true;
+        mGate.unlock();
+        return false;
+    }
+//    An upgrading owner is a reader that also holds mGate. No writer can be
+//  active, or start, while mGate is held, so the reader always gets in.
+    bool try_lock_upgrade_impl (void) noexcept
+    {
+        if (!mGate.try_lock())
+            return false;
+        mState.fetch_add(1, std::memory_order_acquire);
+        return true;
+    }
+    bool try_lock_upgrade_until_impl (time_point deadline) noexcept
+    {
+        if (!mGate.try_lock_until(deadline))
+            return false;
+        mState.fetch_add(1, std::memory_order_acquire);
+        return true;
+    }
+//  The last reader to leave wakes a writer that waits for it.
+    void leave (void) noexcept
+    {
+        std::uint32_t state = mState.fetch_sub(1, std::memory_order_release) - 1;
+        if ((state & kWriter) && !(state & kReaderMask))
+            detail::wake_by_address_all(mState);
+    }
+public:
+    typedef upgrade_mutex * native_handle_type;
+
+    constexpr upgrade_mutex () noexcept : mState(0), mGate() { }
+    upgrade_mutex (const upgrade_mutex&) = delete;
+    upgrade_mutex & operator= (const upgrade_mutex&) = delete;
+#if defined(MINGW_STDTHREADS_LOCK_ORDER_CHECKS)
+    ~upgrade_mutex (void) { detail::lock_destroyed(this); }
+#endif
+
+//  Exclusive ownership
+    void lock (void)
+    {
+#if STDMUTEX_RECURSION_CHECKS
+        DWORD self = mOwnerThread.checkOwnerBeforeLock();
+#endif
+        detail::profiled_lock(this, [this] { return try_lock_impl(); },
+                                    [this] { try_lock_until_impl(time_point::max()); });
+#if STDMUTEX_RECURSION_CHECKS
+        mOwnerThread.setOwnerAfterLock(self);
+#endif
+    }
+    bool try_lock (void)
+    {
+#if STDMUTEX_RECURSION_CHECKS
+        DWORD self = mOwnerThread.checkOwnerBeforeLock();
+#endif
+        bool ret = try_lock_impl();
+        if (ret)
+            detail::lock_acquired(this);
+#if STDMUTEX_RECURSION_CHECKS
+        if (ret)
+            mOwnerThread.setOwnerAfterLock(self);
+#endif
+        return ret;
+    }
+    template<class Rep, class Period>
+    bool try_lock_for (const std::chrono::duration<Rep,Period>& rel_time)
+    {
+#if STDMUTEX_RECURSION_CHECKS
+        DWORD self = mOwnerThread.checkOwnerBeforeLock();
+#endif
+        auto deadline = detail::deadline_after(rel_time);
+        bool ret = detail::profiled_try_lock(this, [this] { return try_lock_impl(); },
+            [this, deadline] { return try_lock_until_impl(deadline); });
+#if STDMUTEX_RECURSION_CHECKS
+        if (ret)
+            mOwnerThread.setOwnerAfterLock(self);
+#endif
+        return ret;
+    }
+    template<class Clock, class Duration>
+    bool try_lock_until (const std::chrono::time_point<Clock,Duration>& cutoff)
+    {
+        return try_lock_for(cutoff - Clock::now());
+    }
+    void unlock (void)
+    {
+#if STDMUTEX_RECURSION_CHECKS
+        mOwnerThread.checkSetOwnerBeforeUnlock();
+#endif
+        detail::lock_released(this);
+        release_writer(0);
+        mGate.unlock();
+    }
+
+//  Shared ownership
+    void lock_shared (void)
+    {
+        detail::profiled_lock(this, [this] { return try_lock_shared_impl(); },
+                                    [this] { try_lock_shared_until_impl(time_point::max()); });
+    }
+    bool try_lock_shared (void)
+    {
+        bool ret = try_lock_shared_impl();
+        if (ret)
+            detail::lock_acquired(this);
+        return ret;
+    }
+    template<class Rep, class Period>
+    bool try_lock_shared_for (const std::chrono::duration<Rep,Period>& rel_time)
+    {
+        auto deadline = detail::deadline_after(rel_time);
+        return detail::profiled_try_lock(this, [this] { return try_lock_shared_impl(); },
+            [this, deadline] { return try_lock_shared_until_impl(deadline); });
+    }
+    template<class Clock, class Duration>
+    bool try_lock_shared_until (const std::chrono::time_point<Clock,Duration>& cutoff)
+    {
+        return try_lock_shared_for(cutoff - Clock::now());
+    }
+    void unlock_shared (void)
+    {
+        detail::lock_released(this);
+        leave();
+    }
+
+//  Upgrade ownership
+    void lock_upgrade (void)
+    {
+        detail::profiled_lock(this, [this] { return try_lock_upgrade_impl(); },
+                                    [this] { try_lock_upgrade_until_impl(time_point::max()); });
+    }
+    bool try_lock_upgrade (void)
+    {
+        bool ret = try_lock_upgrade_impl();
+        if (ret)
+            detail::lock_acquired(this);
+        return ret;
+    }
+    template<class Rep, class Period>
+    bool try_lock_upgrade_for (const std::chrono::duration<Rep,Period>& rel_time)
+    {
+        auto deadline = detail::deadline_after(rel_time);
+        return detail::profiled_try_lock(this,
+            [this] { return try_lock_upgrade_impl(); },
+            [this, deadline] { return try_lock_upgrade_until_impl(deadline); });
+    }
+    template<class Clock, class Duration>
+    bool try_lock_upgrade_until (const std::chrono::time_point<Clock,Duration>& cutoff)
+    {
+        return try_lock_upgrade_for(cutoff - Clock::now());
+    }
+    void unlock_upgrade (void)
+    {
+        detail::lock_released(this);
+        leave();
+        mGate.unlock();
+    }
+
+//    Conversions. Ownership of the mutex is never given up in between, so the
+//  lock diagnostics see a single acquisition.
+    void unlock_upgrade_and_lock (void)
+    {
+//  Block new readers, and stop counting this thread as one.
+        mState.fetch_add(kWriter - 1, std::memory_order_acquire);
+        drain_until(time_point::max());
+#if STDMUTEX_RECURSION_CHECKS
+        mOwnerThread.setOwnerAfterLock(detail::current_thread_id());
+#endif
+    }
+    bool try_unlock_upgrade_and_lock (void)
+    {
+        std::uint32_t state = 1;
+        bool ret = mState.compare_exchange_strong(state, kWriter, std::memory_order_acquire,
+                                                  std::memory_order_relaxed);
+#if STDMUTEX_RECURSION_CHECKS
+        if (ret)
+            mOwnerThread.setOwnerAfterLock(detail::current_thread_id());
+#endif
+        return ret;
+    }
+    void unlock_and_lock_upgrade (void)
+    {
+#if STDMUTEX_RECURSION_CHECKS
+        mOwnerThread.checkSetOwnerBeforeUnlock();
+#endif
+        release_writer(1);
+    }
+    void unlock_and_lock_shared (void)
+    {
+        unlock_and_lock_upgrade();
+        mGate.unlock();
+    }
+    void unlock_upgrade_and_lock_shared (void)
+    {
+        mGate.unlock();
+    }
+//    Succeeds only if no other thread holds the mutex in any mode, since
+//  waiting for other readers to leave could deadlock with another thread
+//  trying the same.
+    bool try_unlock_shared_and_lock (void)
+    {
+        if (!mGate.try_lock())
+            return false;
+        if (try_unlock_upgrade_and_lock())
+            return true;
+        mGate.unlock();
+        return false;
+    }
+    bool try_unlock_shared_and_lock_upgrade (void)
+    {
+        return mGate.try_lock();
+    }
+
+    native_handle_type native_handle (void)
+    {
+        return this;
+    }
+};
+
+//    A reader-writer lock that bounds the wait of both readers and writers, for
+//  mixed workloads where neither side may be starved, or delayed for long. This
+//  is the ticket-based phase-fair lock of Brandenburg and Anderson: the lock
+//  alternates between a phase in which all waiting readers may enter, and one
+//  in which a single writer may. A reader that arrives while a writer is present
+//  waits for at most that one writer, even if more writers are queued; a writer
+//  waits for the writers ahead of it, and for one phase of readers each.
+//    Readers count themselves in on mReadIn and out on mReadOut, in steps of
+//  kReaderStep; the low bits of mReadIn hold whether a writer is present, and
+//  the parity of its ticket, so that readers can tell one writer from the next.
+//  Writers are served in order of the tickets they draw from mWriteIn.
+//    A blocked thread spins for a short while, then sleeps on the word it waits
+//  for through wait_on_address. Threads that release the lock only wake
+//  sleepers if mParked shows that some exist.
+class phase_fair_shared_mutex
+{
+    static constexpr std::uint32_t kPhaseBit = 1;
+    static constexpr std::uint32_t kWriterBit = 2;
+    static constexpr std::uint32_t kWriterBits = kPhaseBit | kWriterBit;
+    static constexpr std::uint32_t kReaderStep = 0x100;
+    static constexpr unsigned kSpinLimit = 128;
+    std::atomic<std::uint32_t> mReadIn;
+    std::atomic<std::uint32_t> mReadOut;
+    std::atomic<std::uint32_t> mWriteIn;
+    std::atomic<std::uint32_t> mWriteOut;
+    std::atomic<std::uint32_t> mParked;
+#if STDMUTEX_RECURSION_CHECKS
+//  Runtime checker for verifying owner threads. Note: Exclusive mode only.
+    _OwnerThread mOwnerThread {};
+#endif
+
+//    Waits while `word` holds a value for which `blocked` returns true. The
+//  count of sleepers is raised before the word is compared for the last time,
+//  and the word is changed before the count is checked, so that either the
+//  sleeper sees the change, or the waking thread sees the sleeper.
+    template<class Blocked>
+    void wait_while (std::atomic<std::uint32_t> & word, Blocked blocked) noexcept
+    {
+        std::uint32_t value = word.load(std::memory_order_seq_cst);
+        for (unsigned spins = 0; blocked(value); value = word.load(std::memory_order_seq_cst))
+        {
+            if (spins < kSpinLimit)
+            {
+                ++spins;
+                YieldProcessor();
+                continue;
+            }
+            mParked.fetch_add(1, std::memory_order_seq_cst);
+            detail::wait_on_address(word, value, detail::kAddressWaitInfinite);
+            mParked.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+    void wake_all (std::atomic<std::uint32_t> & word) noexcept
+    {
+        if (mParked.load(std::memory_order_seq_cst) != 0)
+            detail::wake_by_address_all(word);
+    }
+
+    void lock_shared_impl (void) noexcept
+    {
+        std::uint32_t writer = mReadIn.fetch_add(kReaderStep, std::memory_order_seq_cst) &
+                               kWriterBits;
+//  Wait only for the writer that is present now, not for any that follow it.
+        if (writer != 0)
+            wait_while(mReadIn, [writer] (std::uint32_t value) {
+                return (value & kWriterBits) == writer;
+            });
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+    bool try_lock_shared_impl (void) noexcept
+    {
+        std::uint32_t value = mReadIn.load(std::memory_order_relaxed);
+        while (!(value & kWriterBits))
+            if (mReadIn.compare_exchange_weak(value, value + kReaderStep,
+                                              std::memory_order_seq_cst,
+                                              std::memory_order_relaxed))
+                return true;
+        return false;
+    }
+//    Once its turn has come, a writer announces itself to readers, and waits
+//  for the readers that entered before it to leave.
+    void enter_write_phase (std::uint32_t ticket) noexcept
+    {
+        std::uint32_t readers = mReadIn.fetch_add(kWriterBit | (ticket & kPhaseBit),
+                                                  std::memory_order_seq_cst) & ~kWriterBits;
+        wait_while(mReadOut, [readers] (std::uint32_t value) {
+            return value != readers;
+        });
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+    void lock_impl (void) noexcept
+    {
+        std::uint32_t ticket = mWriteIn.fetch_add(1, std::memory_order_relaxed);
+        wait_while(mWriteOut, [ticket] (std::uint32_t value) {
+            return value != ticket;
+        });
+        enter_write_phase(ticket);
+    }
+//    Succeeds only if neither readers nor writers hold, or wait for, the lock.
+//  Readers may still arrive after the ticket is drawn; then the writer steps
+//  aside, as if it had locked and unlocked at once.
+    bool try_lock_impl (void) noexcept
+    {
+        std::uint32_t ticket = mWriteOut.load(std::memory_order_relaxed);
+        if (mReadIn.load(std::memory_order_relaxed) != mReadOut.load(std::memory_order_relaxed))
+            return false;
+        std::uint32_t expected = ticket;
+        if (!mWriteIn.compare_exchange_strong(expected, ticket + 1, std::memory_order_relaxed))
+            return false;
+        std::uint32_t readers = mReadIn.fetch_add(kWriterBit | (ticket & kPhaseBit),
+                                                  std::memory_order_seq_cst) & ~kWriterBits;
+        if (mReadOut.load(std::memory_order_seq_cst) == readers)
+        {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return true;
+        }
+        unlock_impl();
+        return false;
+    }
+    void unlock_impl (void) noexcept
+    {
+        mReadIn.fetch_and(~kWriterBits, std::memory_order_seq_cst);
+        mWriteOut.fetch_add(1, std::memory_order_seq_cst);
+        if (mParked.load(std::memory_order_seq_cst) != 0)
+        {
+            detail::wake_by_address_all(mReadIn);
+            detail::wake_by_address_all(mWriteOut);
         }
-        while (true);
     }
+public:
+    typedef phase_fair_shared_mutex * native_handle_type;
 
-    bool try_lock_shared (void)
+    constexpr phase_fair_shared_mutex () noexcept
+        : mReadIn(0), mReadOut(0), mWriteIn(0), mWriteOut(0), mParked(0)
     {
-        counter_type expected = mCounter.load(std::memory_order_relaxed) & static_cast<counter_type>(~kWriteBit);
-        if (expected + 1 == kWriteBit)
-            return false;
-        else
-            return mCounter.compare_exchange_strong( expected,
-                                                    static_cast<counter_type>(expected + 1),
-                                                    std::memory_order_acquire,
-                                                    std::memory_order_relaxed);
     }
+    phase_fair_shared_mutex (const phase_fair_shared_mutex&) = delete;
+    phase_fair_shared_mutex & operator= (const phase_fair_shared_mutex&) = delete;
+#if defined(MINGW_STDTHREADS_LOCK_ORDER_CHECKS)
+    ~phase_fair_shared_mutex (void) { detail::lock_destroyed(this); }
+#endif
 
+    void lock_shared (void)
+    {
+        detail::profiled_lock(this, [this] { return try_lock_shared_impl(); },
+                                    [this] { lock_shared_impl(); });
+    }
+    bool try_lock_shared (void)
+    {
+        bool ret = try_lock_shared_impl();
+        if (ret)
+            detail::lock_acquired(this);
+        return ret;
+    }
     void unlock_shared (void)
     {
-        using namespace std;
-#ifndef NDEBUG
-        if (!(mCounter.fetch_sub(1, memory_order_release) & static_cast<counter_type>(~kWriteBit)))
-            throw system_error(make_error_code(errc::operation_not_permitted));
-#else
-        mCounter.fetch_sub(1, memory_order_release);
-#endif
+        detail::lock_released(this);
+        mReadOut.fetch_add(kReaderStep, std::memory_order_seq_cst);
+//  Only a writer waits on mReadOut, and only once it has set its bit.
+        if (mReadIn.load(std::memory_order_seq_cst) & kWriterBit)
+            wake_all(mReadOut);
     }
 
-//  Behavior is undefined if a lock was previously acquired.
     void lock (void)
     {
 #if STDMUTEX_RECURSION_CHECKS
         DWORD self = mOwnerThread.checkOwnerBeforeLock();
 #endif
-        using namespace std;
-//  Might be able to use relaxed memory order...
-//  Wait for the write-lock to be unlocked, then claim the write slot.
-        counter_type current;
-        while ((current = mCounter.fetch_or(kWriteBit, std::memory_order_acquire)) & kWriteBit);
-            //this_thread::yield();
-//  Wait for readers to finish up.
-        while (current != kWriteBit)
-        {
-            //this_thread::yield();
-            current = mCounter.load(std::memory_order_acquire);
-        }
+        detail::profiled_lock(this, [this] { return try_lock_impl(); },
+                                    [this] { lock_impl(); });
 #if STDMUTEX_RECURSION_CHECKS
         mOwnerThread.setOwnerAfterLock(self);
 #endif
     }
-
     bool try_lock (void)
     {
 #if STDMUTEX_RECURSION_CHECKS
         DWORD self = mOwnerThread.checkOwnerBeforeLock();
 #endif
-        counter_type expected = 0;
-        bool ret = mCounter.compare_exchange_strong(expected, kWriteBit,
-                                                    std::memory_order_acquire,
-                                                    std::memory_order_relaxed);
+        bool ret = try_lock_impl();
+        if (ret)
+            detail::lock_acquired(this);
 #if STDMUTEX_RECURSION_CHECKS
         if (ret)
             mOwnerThread.setOwnerAfterLock(self);
 #endif
         return ret;
     }
-
     void unlock (void)
     {
 #if STDMUTEX_RECURSION_CHECKS
         mOwnerThread.checkSetOwnerBeforeUnlock();
 #endif
-        using namespace std;
-#ifndef NDEBUG
-        if (mCounter.load(memory_order_relaxed) != kWriteBit)
-            throw system_error(make_error_code(errc::operation_not_permitted));
-#endif
-        mCounter.store(0, memory_order_release);
+        detail::lock_released(this);
+        unlock_impl();
     }
 
     native_handle_type native_handle (void)
@@ -198,110 +1125,6 @@ public:
     }
 };
 
-} //  Namespace portable
-
-//    The native shared_mutex implementation primarily uses features of Windows
-//  Vista, but the features used for try_lock and try_lock_shared were not
-//  introduced until Windows 7. To allow limited use while compiling for Vista,
-//  I define the class without try_* functions in that case.
-//    Only fully-featured implementations will be placed into namespace std.
-#if defined(_WIN32) && (WINVER >= _WIN32_WINNT_VISTA)
-namespace vista
-{
-class condition_variable_any;
-}
-
-namespace windows7
-{
-//  We already #include "mingw.mutex.h". May as well reduce redundancy.
-class shared_mutex : windows7::mutex
-{
-//    Allow condition_variable_any (and only condition_variable_any) to treat a
-//  shared_mutex as its base class.
-    friend class vista::condition_variable_any;
-public:
-    using windows7::mutex::native_handle_type;
-    using windows7::mutex::lock;
-    using windows7::mutex::unlock;
-    using windows7::mutex::native_handle;
-
-    void lock_shared (void)
-    {
-        AcquireSRWLockShared(native_handle());
-    }
-
-    void unlock_shared (void)
-    {
-        ReleaseSRWLockShared(native_handle());
-    }
-
-//  TryAcquireSRW functions are a Windows 7 feature.
-#if (WINVER >= _WIN32_WINNT_WIN7)
-    bool try_lock_shared (void)
-    {
-        return TryAcquireSRWLockShared(native_handle()) != 0;
-    }
-
-    using windows7::mutex::try_lock;
-#endif
-};
-
-} //  Namespace windows7
-#endif  //  Compiling for Vista
-#if (defined(_WIN32) && (WINVER >= _WIN32_WINNT_WIN7))
-using windows7::shared_mutex;
-#else
-using portable::shared_mutex;
-#endif
-
-class shared_timed_mutex : shared_mutex
-{
-    typedef shared_mutex Base;
-public:
-    using Base::lock;
-    using Base::try_lock;
-    using Base::unlock;
-    using Base::lock_shared;
-    using Base::try_lock_shared;
-    using Base::unlock_shared;
-
-    template< class Clock, class Duration >
-    bool try_lock_until ( const std::chrono::time_point<Clock,Duration>& cutoff )
-    {
-        do
-        {
-            if (try_lock())
-                return true;
-        }
-        while (std::chrono::steady_clock::now() < cutoff);
-        return false;
-    }
-
-    template< class Rep, class Period >
-    bool try_lock_for (const std::chrono::duration<Rep,Period>& rel_time)
-    {
-        return try_lock_until(std::chrono::steady_clock::now() + rel_time);
-    }
-
-    template< class Clock, class Duration >
-    bool try_lock_shared_until ( const std::chrono::time_point<Clock,Duration>& cutoff )
-    {
-        do
-        {
-            if (try_lock_shared())
-                return true;
-        }
-        while (std::chrono::steady_clock::now() < cutoff);
-        return false;
-    }
-
-    template< class Rep, class Period >
-    bool try_lock_shared_for (const std::chrono::duration<Rep,Period>& rel_time)
-    {
-        return try_lock_shared_until(std::chrono::steady_clock::now() + rel_time);
-    }
-};
-
 #if __cplusplus >= 201402L
 using std::shared_lock;
 #else
@@ -412,20 +1235,16 @@ public:
     bool try_lock_until( const std::chrono::time_point<Clock,Duration>& cutoff )
     {
         verify_lockable();
-        do
-        {
-            mOwns = mMutex->try_lock_shared();
-            if (mOwns)
-                return mOwns;
-        }
-        while (std::chrono::steady_clock::now() < cutoff);
-        return false;
+        mOwns = mMutex->try_lock_shared_until(cutoff);
+        return mOwns;
     }
 
     template< class Rep, class Period >
     bool try_lock_for (const std::chrono::duration<Rep,Period>& rel_time)
     {
-        return try_lock_until(std::chrono::steady_clock::now() + rel_time);
+        verify_lockable();
+        mOwns = mMutex->try_lock_shared_for(rel_time);
+        return mOwns;
     }
 
     void unlock (void)
@@ -475,6 +1294,158 @@ void swap( shared_lock<Mutex>& lhs, shared_lock<Mutex>& rhs ) noexcept
     lhs.swap(rhs);
 }
 #endif  //  C++11
+
+//    Holds upgrade ownership of a mutex such as upgrade_mutex, in the manner of
+//  shared_lock. To write, convert the ownership through the mutex, and adopt
+//  it in a unique_lock:
+//      upgrade_lock<upgrade_mutex> check (mtx);
+//      if (needs_update())
+//      {
+//          unique_lock<upgrade_mutex> update (*check.release(), adopt_lock);
+//          update.mutex()->unlock_upgrade_and_lock();
+//          ...
+//      }
+template<class Mutex>
+class upgrade_lock
+{
+    Mutex * mMutex;
+    bool mOwns;
+    void verify_lockable (void)
+    {
+        using namespace std;
+        if (mMutex == nullptr)
+            throw system_error(make_error_code(errc::operation_not_permitted));
+        if (mOwns)
+            throw system_error(make_error_code(errc::resource_deadlock_would_occur));
+    }
+public:
+    typedef Mutex mutex_type;
+
+    upgrade_lock (void) noexcept
+        : mMutex(nullptr), mOwns(false)
+    {
+    }
+    upgrade_lock (upgrade_lock<Mutex> && other) noexcept
+        : mMutex(other.mMutex), mOwns(other.mOwns)
+    {
+        other.mMutex = nullptr;
+        other.mOwns = false;
+    }
+    explicit upgrade_lock (mutex_type & m)
+        : mMutex(&m), mOwns(true)
+    {
+        mMutex->lock_upgrade();
+    }
+    upgrade_lock (mutex_type & m, defer_lock_t) noexcept
+        : mMutex(&m), mOwns(false)
+    {
+    }
+    upgrade_lock (mutex_type & m, adopt_lock_t)
+        : mMutex(&m), mOwns(true)
+    {
+    }
+    upgrade_lock (mutex_type & m, try_to_lock_t)
+        : mMutex(&m), mOwns(m.try_lock_upgrade())
+    {
+    }
+    template< class Rep, class Period >
+    upgrade_lock (mutex_type& m, const std::chrono::duration<Rep,Period>& timeout_duration)
+        : mMutex(&m), mOwns(m.try_lock_upgrade_for(timeout_duration))
+    {
+    }
+    template< class Clock, class Duration >
+    upgrade_lock (mutex_type& m, const std::chrono::time_point<Clock,Duration>& timeout_time)
+        : mMutex(&m), mOwns(m.try_lock_upgrade_until(timeout_time))
+    {
+    }
+    upgrade_lock& operator= (upgrade_lock<Mutex> && other) noexcept
+    {
+        if (&other != this)
+        {
+            if (mOwns)
+                mMutex->unlock_upgrade();
+            mMutex = other.mMutex;
+            mOwns = other.mOwns;
+            other.mMutex = nullptr;
+            other.mOwns = false;
+        }
+        return *this;
+    }
+    ~upgrade_lock (void)
+    {
+        if (mOwns)
+            mMutex->unlock_upgrade();
+    }
+    upgrade_lock (const upgrade_lock<Mutex> &) = delete;
+    upgrade_lock& operator= (const upgrade_lock<Mutex> &) = delete;
+
+    void lock (void)
+    {
+        verify_lockable();
+        mMutex->lock_upgrade();
+        mOwns = true;
+    }
+    bool try_lock (void)
+    {
+        verify_lockable();
+        mOwns = mMutex->try_lock_upgrade();
+        return mOwns;
+    }
+    template< class Rep, class Period >
+    bool try_lock_for (const std::chrono::duration<Rep,Period>& rel_time)
+    {
+        verify_lockable();
+        mOwns = mMutex->try_lock_upgrade_for(rel_time);
+        return mOwns;
+    }
+    template< class Clock, class Duration >
+    bool try_lock_until (const std::chrono::time_point<Clock,Duration>& cutoff)
+    {
+        verify_lockable();
+        mOwns = mMutex->try_lock_upgrade_until(cutoff);
+        return mOwns;
+    }
+    void unlock (void)
+    {
+        using namespace std;
+        if (!mOwns)
+            throw system_error(make_error_code(errc::operation_not_permitted));
+        mMutex->unlock_upgrade();
+        mOwns = false;
+    }
+
+    void swap (upgrade_lock<Mutex> & other) noexcept
+    {
+        using namespace std;
+        swap(mMutex, other.mMutex);
+        swap(mOwns, other.mOwns);
+    }
+    mutex_type * release (void) noexcept
+    {
+        mutex_type * ptr = mMutex;
+        mMutex = nullptr;
+        mOwns = false;
+        return ptr;
+    }
+    mutex_type * mutex (void) const noexcept
+    {
+        return mMutex;
+    }
+    bool owns_lock (void) const noexcept
+    {
+        return mOwns;
+    }
+    explicit operator bool () const noexcept
+    {
+        return owns_lock();
+    }
+};
+
+template< class Mutex >
+void swap( upgrade_lock<Mutex>& lhs, upgrade_lock<Mutex>& rhs ) noexcept
+{
+    lhs.swap(rhs);
+}
 } //  Namespace mingw_stdthread
 
 namespace std
@@ -36,9 +36,13 @@
 #include <chrono>       //  For sleep timing.
 #include <memory>       //  For std::unique_ptr
 #include <iosfwd>       //  Stream output for thread ids.
+#include <string>       //  For std::wstring
+#include <type_traits>  //  For std::enable_if
 #include <utility>      //  For std::swap, std::forward
 
 #include "mingw.invoke.h"
+//  For the sleep functions
+#include "mingw.precise_sleep.h"
 
 #if (defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
 #pragma message "The Windows API that MinGW-w32 provides is not fully compatible\
@@ -50,6 +54,8 @@
 #include <handleapi.h>  //  For CloseHandle, etc.
 #include <sysinfoapi.h> //  For GetNativeSystemInfo
 #include <processthreadsapi.h>  //  For GetCurrentThreadId
+#include <libloaderapi.h>       //  For GetModuleHandleW, GetProcAddress
+#include <errhandlingapi.h>     //  For GetLastError
 #endif
 #include <process.h>  //  For _beginthreadex
 
@@ -101,6 +107,28 @@ namespace detail
         }
     };
 
+//    A call for a thread that is created suspended. If the thread cannot be set
+//  up as requested, the creating thread cancels the call before resuming it,
+//  and the thread exits without making it.
+    template<class Call>
+    struct SuspendedCall
+    {
+        Call mCall;
+        bool mCancelled;
+
+        template<class ... Args>
+        explicit SuspendedCall(Args&&... args)
+          : mCall(std::forward<Args>(args)...), mCancelled(false)
+        {
+        }
+
+        void callFunc()
+        {
+            if (!mCancelled)
+                mCall.callFunc();
+        }
+    };
+
 //  Allow construction of threads without exposing implementation.
     class ThreadIdTool;
 } //  Namespace "detail"
@@ -152,6 +180,22 @@ private:
         return 0;
     }
 
+//    SetThreadDescription was added in Windows 10, version 1607, so it is
+//  looked up at run time. Returns nullptr where it does not exist.
+    typedef long (__stdcall * SetDescriptionFunc)(HANDLE, wchar_t const *);
+    static SetDescriptionFunc set_description_func() noexcept
+    {
+        static SetDescriptionFunc const func = []() noexcept -> SetDescriptionFunc
+        {
+            auto kernel = GetModuleHandleW(L"kernel32.dll");
+            if (kernel == nullptr)
+                return nullptr;
+            return reinterpret_cast<SetDescriptionFunc>(
+                reinterpret_cast<void (*)()>(GetProcAddress(kernel, "SetThreadDescription")));
+        }();
+        return func;
+    }
+
     static unsigned int _hardware_concurrency_helper() noexcept
     {
         SYSTEM_INFO sysinfo;
@@ -167,6 +211,24 @@ private:
     }
 public:
     typedef HANDLE native_handle_type;
+
+//    How to create a thread, for the constructor that takes them. The defaults
+//  are those of the other constructors.
+    struct attributes
+    {
+//    Address space to reserve for the stack, in bytes. Windows rounds it up to
+//  a multiple of 64 KiB. If 0, the size in the executable's header is used,
+//  usually 1 MiB. Only one page is committed at first either way.
+        std::size_t stack_size = 0;
+//  One of the THREAD_PRIORITY_ values, set before the thread starts.
+        int priority = 0;   //  THREAD_PRIORITY_NORMAL
+//    Shown by debuggers and profilers. Ignored before Windows 10, version
+//  1607, which added thread descriptions.
+        std::wstring name;
+//  If true, the thread does not run until ResumeThread(native_handle()).
+        bool suspended = false;
+    };
+
     id get_id() const noexcept {return mThreadId;}
     native_handle_type native_handle() const {return mHandle;}
     thread(): mHandle(kInvalidHandle), mThreadId(){}
@@ -180,7 +242,8 @@ public:
 
     thread(const thread &other)=delete;
 
-    template<class Func, typename... Args>
+    template<class Func, typename... Args, class = typename std::enable_if<
+        !std::is_same<typename std::decay<Func>::type, attributes>::value>::type>
     explicit thread(Func&& func, Args&&... args) : mHandle(), mThreadId()
     {
         using ArgSequence = typename detail::GenIntSeq<sizeof...(Args)>::type;
@@ -203,6 +266,61 @@ public:
         }
     }
 
+//    The thread is created suspended, and resumed only once its priority and
+//  name have been set, so that none of `func` runs without them.
+    template<class Func, typename... Args>
+    thread(const attributes & attrs, Func&& func, Args&&... args)
+        : mHandle(), mThreadId()
+    {
+        constexpr unsigned kCreateSuspended = 0x00000004;
+        constexpr unsigned kStackSizeIsReservation = 0x00010000;
+        using ArgSequence = typename detail::GenIntSeq<sizeof...(Args)>::type;
+        using Call = detail::SuspendedCall<
+            detail::ThreadFuncCall<Func, ArgSequence, Args...> >;
+        auto call = new Call(
+            std::forward<Func>(func), std::forward<Args>(args)...);
+        unsigned flags = kCreateSuspended;
+        if (attrs.stack_size != 0)
+            flags |= kStackSizeIsReservation;
+//  _beginthreadex takes the stack size as an unsigned. Larger sizes fail.
+        unsigned stack_size = static_cast<unsigned>(attrs.stack_size);
+        if (stack_size != attrs.stack_size)
+        {
+            delete call;
+            throw std::system_error(std::make_error_code(std::errc::invalid_argument));
+        }
+        unsigned id_receiver;
+        auto int_handle = _beginthreadex(NULL, stack_size, threadfunc<Call>,
+            static_cast<LPVOID>(call), flags, &id_receiver);
+        if (int_handle == 0)
+        {
+            int errnum = errno;
+            delete call;
+            throw std::system_error(errnum, std::generic_category());
+        }
+        HANDLE handle = reinterpret_cast<HANDLE>(int_handle);
+        if ((attrs.priority != 0) && !SetThreadPriority(handle, attrs.priority))
+        {
+//  The thread owns the call. Let it exit without making it.
+            DWORD error = GetLastError();
+            call->mCancelled = true;
+            ResumeThread(handle);
+            WaitForSingleObject(handle, kInfinite);
+            CloseHandle(handle);
+            throw std::system_error(static_cast<int>(error), std::system_category());
+        }
+        if (!attrs.name.empty())
+        {
+            SetDescriptionFunc set_description = set_description_func();
+            if (set_description != nullptr)
+                set_description(handle, attrs.name.c_str());
+        }
+        mThreadId.mId = id_receiver;
+        mHandle = handle;
+        if (!attrs.suspended)
+            ResumeThread(handle);
+    }
+
     bool joinable() const {return mHandle != kInvalidHandle;}
 
 //    Note: Due to lack of synchronization, this function has a race condition
@@ -299,22 +417,21 @@ namespace this_thread
     template< class Rep, class Period >
     void sleep_for( const std::chrono::duration<Rep,Period>& sleep_duration)
     {
-        static constexpr DWORD kInfinite = 0xffffffffl;
-        using namespace std::chrono;
-        using rep = milliseconds::rep;
-        rep ms = duration_cast<milliseconds>(sleep_duration).count();
-        while (ms > 0)
-        {
-            constexpr rep kMaxRep = static_cast<rep>(kInfinite - 1);
-            auto sleepTime = (ms < kMaxRep) ? ms : kMaxRep;
-            Sleep(static_cast<DWORD>(sleepTime));
-            ms -= sleepTime;
-        }
+        if (sleep_duration > sleep_duration.zero())
+            detail::sleep_precisely_until(detail::deadline_after(sleep_duration));
     }
+//    The deadline is measured on its own clock, which need not advance with the
+//  steady clock that the sleeps are timed by. Check it again after each sleep.
     template <class Clock, class Duration>
     void sleep_until(const std::chrono::time_point<Clock,Duration>& sleep_time)
     {
-        sleep_for(sleep_time-Clock::now());
+        for (;;)
+        {
+            auto remaining = sleep_time - Clock::now();
+            if (remaining <= remaining.zero())
+                return;
+            detail::sleep_precisely_until(detail::deadline_after(remaining));
+        }
     }
 }
 } //  Namespace mingw_stdthread
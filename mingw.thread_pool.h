@@ -0,0 +1,418 @@
+/// \file mingw.thread_pool.h
+/// \brief A work-stealing pool of threads, for running many short tasks.
+///
+/// (c) 2013-2016 by Mega Limited, Auckland, New Zealand
+///
+/// \copyright Simplified (2-clause) BSD License.
+///
+/// \note This file may become part of the mingw-w64 runtime package. If/when
+/// this happens, the appropriate license will be added, i.e. this code will
+/// become dual-licensed, and the current BSD 2-clause license will stay.
+
+//    A queue shared by every worker, and protected by a mutex, makes every
+//  worker take the same lock for every task. Here, each worker has a deque of
+//  its own (the Chase-Lev deque). A worker pushes and pops at one end of its
+//  deque without locking, and only takes the other end of another worker's
+//  deque, atomically, when its own is empty. Tasks submitted by a task go to
+//  the deque of the worker that runs it. Tasks submitted from other threads go
+//  to an injection queue, which is protected by a mutex, and taken from there
+//  by whichever worker gets to them first.
+//    A worker that finds no task sleeps on a word with wait_on_address, and
+//  is woken when a task is submitted. Submitting wakes nobody if no worker
+//  sleeps, which costs one fence and one load.
+//    A task that waits for another task of the same pool holds its worker
+//  while it waits. If every worker waited in this way, no task would finish.
+
+#ifndef MINGW_THREAD_POOL_H_
+#define MINGW_THREAD_POOL_H_
+
+#if !defined(__cplusplus) || (__cplusplus < 201103L)
+#error A C++11 compiler is required!
+#endif
+
+#include <atomic>
+#include <cstddef>          //  For std::size_t, std::ptrdiff_t
+#include <cstdint>          //  For std::uint32_t
+#include <memory>           //  For std::unique_ptr
+#include <system_error>
+#include <type_traits>
+#include <utility>          //  For std::declval, std::forward, std::move
+#include <vector>
+
+#include "mingw.thread.h"
+#include "mingw.mutex.h"
+//  For future, and for the AsyncTask and PoolTask classes.
+#include "mingw.future.h"
+#include "mingw.wait_on_address.h"
+
+namespace mingw_stdthread
+{
+class thread_pool;
+
+namespace detail
+{
+//    The deque of one worker. Only the owner calls push and pop; any thread
+//  may call steal. The indices only grow: `bottom` when the owner pushes, and
+//  `top` when a task is stolen, or the owner pops the last one. When the array
+//  is full, the owner copies the tasks into an array twice as large. Thieves
+//  may still be reading the old array, so it is kept until the deque is
+//  destroyed; at most as much memory as the current array is retired.
+class ChaseLevDeque
+{
+    struct Buffer
+    {
+        std::size_t mMask;
+        std::atomic<AsyncTask *> * mSlots;
+        Buffer * mRetired;
+
+        explicit Buffer (std::size_t capacity)
+            : mMask(capacity - 1), mSlots(new std::atomic<AsyncTask *> [capacity]),
+              mRetired(nullptr)
+        {
+        }
+        ~Buffer (void)
+        {
+            delete[] mSlots;
+        }
+        std::size_t capacity (void) const noexcept
+        {
+            return mMask + 1;
+        }
+        AsyncTask * get (std::ptrdiff_t index) const noexcept
+        {
+            return mSlots[static_cast<std::size_t>(index) & mMask].load(std::memory_order_relaxed);
+        }
+        void put (std::ptrdiff_t index, AsyncTask * task) noexcept
+        {
+            mSlots[static_cast<std::size_t>(index) & mMask].store(task, std::memory_order_relaxed);
+        }
+    };
+    static constexpr std::size_t kInitialCapacity = 64;
+//  Thieves write `top`, and the owner writes `bottom`; keep them apart.
+    std::atomic<std::ptrdiff_t> mTop;
+    char mPadding [64];
+    std::atomic<std::ptrdiff_t> mBottom;
+    std::atomic<Buffer *> mBuffer;
+
+    Buffer * grow (Buffer * old, std::ptrdiff_t top, std::ptrdiff_t bottom)
+    {
+        Buffer * bigger = new Buffer(old->capacity() * 2);
+        for (std::ptrdiff_t i = top; i != bottom; ++i)
+            bigger->put(i, old->get(i));
+        bigger->mRetired = old;
+        mBuffer.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+public:
+    ChaseLevDeque (void)
+        : mTop(0), mPadding(), mBottom(0), mBuffer(new Buffer(kInitialCapacity))
+    {
+    }
+    ~ChaseLevDeque (void)
+    {
+        Buffer * buffer = mBuffer.load(std::memory_order_relaxed);
+        while (buffer != nullptr)
+        {
+            Buffer * retired = buffer->mRetired;
+            delete buffer;
+            buffer = retired;
+        }
+    }
+    ChaseLevDeque (const ChaseLevDeque&) = delete;
+    ChaseLevDeque & operator= (const ChaseLevDeque&) = delete;
+
+    void push (AsyncTask * task)
+    {
+        std::ptrdiff_t bottom = mBottom.load(std::memory_order_relaxed);
+        std::ptrdiff_t top = mTop.load(std::memory_order_acquire);
+        Buffer * buffer = mBuffer.load(std::memory_order_relaxed);
+        if (bottom - top >= static_cast<std::ptrdiff_t>(buffer->capacity()))
+            buffer = grow(buffer, top, bottom);
+        buffer->put(bottom, task);
+        mBottom.store(bottom + 1, std::memory_order_release);
+    }
+//    Takes the newest task. The owner claims the slot by lowering `bottom`
+//  first; only the last task can be contested, and is then settled on `top`.
+    AsyncTask * pop (void) noexcept
+    {
+        std::ptrdiff_t bottom = mBottom.load(std::memory_order_relaxed) - 1;
+        Buffer * buffer = mBuffer.load(std::memory_order_relaxed);
+        mBottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::ptrdiff_t top = mTop.load(std::memory_order_relaxed);
+        if (top > bottom)
+        {
+            mBottom.store(bottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        AsyncTask * task = buffer->get(bottom);
+        if (top == bottom)
+        {
+            if (!mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                              std::memory_order_relaxed))
+                task = nullptr;
+            mBottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return task;
+    }
+//  Takes the oldest task. Returns nullptr if the deque is empty, or if another
+//  thread took the task first.
+    AsyncTask * steal (void) noexcept
+    {
+        std::ptrdiff_t top = mTop.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::ptrdiff_t bottom = mBottom.load(std::memory_order_acquire);
+        if (top >= bottom)
+            return nullptr;
+        AsyncTask * task = mBuffer.load(std::memory_order_acquire)->get(top);
+        if (!mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                          std::memory_order_relaxed))
+            return nullptr;
+        return task;
+    }
+    bool empty (void) const noexcept
+    {
+        return mBottom.load(std::memory_order_relaxed) <= mTop.load(std::memory_order_relaxed);
+    }
+};
+
+//    Use a class template to allow instantiation of statics in a header-only
+//  library.
+template<bool>
+struct ThreadPoolStatic
+{
+//  The pool and the index of this thread, if it is a worker.
+    static thread_local thread_pool * tPool;
+    static thread_local std::size_t tIndex;
+};
+template<bool b>
+thread_local thread_pool * ThreadPoolStatic<b>::tPool = nullptr;
+template<bool b>
+thread_local std::size_t ThreadPoolStatic<b>::tIndex = 0;
+} //  Namespace "detail"
+
+class thread_pool
+{
+    typedef detail::ThreadPoolStatic<true> Static;
+    static constexpr DWORD kInfinite = 0xffffffffl;
+
+    struct Worker
+    {
+        detail::ChaseLevDeque mDeque;
+        thread mThread;
+    };
+    std::vector<std::unique_ptr<Worker> > mWorkers;
+//  Tasks submitted by threads that are not workers of this pool.
+    mutex mInjectionMutex;
+    detail::AsyncTask * mInjectionHead;
+    detail::AsyncTask * mInjectionTail;
+    std::atomic<std::size_t> mInjected;
+//  Workers sleep until mWake changes.
+    std::atomic<std::uint32_t> mWake;
+    std::atomic<unsigned> mSleepers;
+//  Tasks submitted and not yet finished, and the threads in wait_idle.
+    std::atomic<std::uint32_t> mPending;
+    std::atomic<unsigned> mIdleWaiters;
+    std::atomic<bool> mStopping;
+
+    detail::AsyncTask * take_injected (void)
+    {
+        if (mInjected.load(std::memory_order_acquire) == 0)
+            return nullptr;
+        lock_guard<mutex> guard (mInjectionMutex);
+        detail::AsyncTask * task = mInjectionHead;
+        if (task == nullptr)
+            return nullptr;
+        mInjectionHead = task->mNext;
+        if (mInjectionHead == nullptr)
+            mInjectionTail = nullptr;
+        mInjected.fetch_sub(1, std::memory_order_relaxed);
+        return task;
+    }
+    detail::AsyncTask * find_task (std::size_t index)
+    {
+        detail::AsyncTask * task = mWorkers[index]->mDeque.pop();
+        if (task == nullptr)
+            task = take_injected();
+//  Steal from the others, starting with the next worker.
+        std::size_t count = mWorkers.size();
+        for (std::size_t i = 1; (task == nullptr) && (i < count); ++i)
+        {
+            detail::ChaseLevDeque & victim = mWorkers[(index + i) % count]->mDeque;
+            while ((task == nullptr) && !victim.empty())
+                task = victim.steal();
+        }
+        return task;
+    }
+//  Uncounts a task, and wakes the threads in wait_idle if it was the last.
+    void finish_task (void) noexcept
+    {
+        if (mPending.fetch_sub(1, std::memory_order_seq_cst) == 1)
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (mIdleWaiters.load(std::memory_order_relaxed) != 0)
+                detail::wake_by_address_all(mPending);
+        }
+    }
+    void run_task (detail::AsyncTask * task)
+    {
+        task->run();
+        delete task;
+        finish_task();
+    }
+    void work (std::size_t index)
+    {
+        Static::tPool = this;
+        Static::tIndex = index;
+        for (;;)
+        {
+            detail::AsyncTask * task = find_task(index);
+            if (task != nullptr)
+            {
+                run_task(task);
+                continue;
+            }
+//    Announce the sleep before looking once more, so that a task submitted in
+//  the meantime is either found here, or wakes this worker.
+            std::uint32_t wake = mWake.load(std::memory_order_acquire);
+            mSleepers.fetch_add(1, std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            task = find_task(index);
+            if (task == nullptr)
+            {
+//  The pool stops only once every task has finished.
+                if (mStopping.load(std::memory_order_seq_cst))
+                {
+                    mSleepers.fetch_sub(1, std::memory_order_relaxed);
+                    return;
+                }
+                detail::wait_on_address(mWake, wake, kInfinite);
+            }
+            mSleepers.fetch_sub(1, std::memory_order_relaxed);
+            if (task != nullptr)
+                run_task(task);
+        }
+    }
+    void wake_one (void) noexcept
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (mSleepers.load(std::memory_order_relaxed) == 0)
+            return;
+        mWake.fetch_add(1, std::memory_order_release);
+        detail::wake_by_address_single(mWake);
+    }
+//    The task is counted before it is queued, so that a worker cannot finish
+//  it first and let wait_idle return early. Growing the deque and locking the
+//  injection queue may throw; both do so before the task is queued, so the
+//  count is taken back and the caller still owns the task. Otherwise the
+//  count would never return to zero, and wait_idle and the destructor would
+//  block for good.
+    void enqueue (detail::AsyncTask * task)
+    {
+        mPending.fetch_add(1, std::memory_order_relaxed);
+        try {
+            if (Static::tPool == this)
+                mWorkers[Static::tIndex]->mDeque.push(task);
+            else
+            {
+                lock_guard<mutex> guard (mInjectionMutex);
+                if (mInjectionTail != nullptr)
+                    mInjectionTail->mNext = task;
+                else
+                    mInjectionHead = task;
+                mInjectionTail = task;
+                mInjected.fetch_add(1, std::memory_order_release);
+            }
+        } catch (...) {
+            finish_task();
+            throw;
+        }
+        wake_one();
+    }
+public:
+//  Starts `num_threads` workers (at least one).
+    explicit thread_pool (unsigned num_threads = thread::hardware_concurrency())
+        : mWorkers(), mInjectionMutex(), mInjectionHead(nullptr), mInjectionTail(nullptr),
+          mInjected(0), mWake(0), mSleepers(0), mPending(0), mIdleWaiters(0),
+          mStopping(false)
+    {
+        if (num_threads == 0)
+            num_threads = 1;
+        for (unsigned i = 0; i < num_threads; ++i)
+            mWorkers.emplace_back(new Worker());
+        try {
+            for (std::size_t i = 0; i < mWorkers.size(); ++i)
+                mWorkers[i]->mThread = thread([this, i] (void) { work(i); });
+        } catch (...) {
+            stop();
+            throw;
+        }
+    }
+//  Runs every task that has been submitted, then stops the workers.
+    ~thread_pool (void)
+    {
+        stop();
+    }
+    thread_pool (const thread_pool&) = delete;
+    thread_pool & operator= (const thread_pool&) = delete;
+
+    std::size_t size (void) const noexcept
+    {
+        return mWorkers.size();
+    }
+
+//    Queues invoke(func, args...) to run on a worker, and returns a future for
+//  its result. The function and arguments are copied or moved, as for a new
+//  thread.
+    template<class Func, class ... Args>
+    future<decltype(detail::invoke(std::declval<typename std::decay<Func>::type>(),
+                                   std::declval<typename std::decay<Args>::type>()...))>
+        submit (Func && func, Args&&... args)
+    {
+        typedef decltype(detail::invoke(std::declval<typename std::decay<Func>::type>(),
+                                        std::declval<typename std::decay<Args>::type>()...)) Result;
+        typedef typename detail::GenIntSeq<sizeof...(Args)>::type Indices;
+        typedef detail::PoolTask<Result, Func, Indices, Args...> Task;
+        std::unique_ptr<Task> task (new Task(std::forward<Func>(func), std::forward<Args>(args)...));
+        future<Result> result = task->get_future();
+        enqueue(task.get());
+        task.release();
+        return result;
+    }
+
+//    Blocks until every submitted task, including those submitted while
+//  waiting, has finished. A task of this pool cannot wait for the pool to be
+//  idle, since it is not finished itself.
+    void wait_idle (void)
+    {
+        if (Static::tPool == this)
+            throw std::system_error(std::make_error_code(std::errc::resource_deadlock_would_occur));
+        wait_for_tasks();
+    }
+private:
+    void wait_for_tasks (void) noexcept
+    {
+        mIdleWaiters.fetch_add(1, std::memory_order_seq_cst);
+        for (;;)
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            std::uint32_t pending = mPending.load(std::memory_order_acquire);
+            if (pending == 0)
+                break;
+            detail::wait_on_address(mPending, pending, kInfinite);
+        }
+        mIdleWaiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+    void stop (void) noexcept
+    {
+        wait_for_tasks();
+        mStopping.store(true, std::memory_order_seq_cst);
+        mWake.fetch_add(1, std::memory_order_release);
+        detail::wake_by_address_all(mWake);
+        for (std::unique_ptr<Worker> & worker : mWorkers)
+            if (worker->mThread.joinable())
+                worker->mThread.join();
+    }
+};
+} //  Namespace "mingw_stdthread"
+#endif // MINGW_THREAD_POOL_H_
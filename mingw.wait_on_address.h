@@ -0,0 +1,327 @@
+/// \file mingw.wait_on_address.h
+/// \brief Waiting on the value of a 32-bit word, for every supported Windows
+///   version. Used internally by the other headers of this library.
+///
+/// (c) 2013-2016 by Mega Limited, Auckland, New Zealand
+///
+/// \copyright Simplified (2-clause) BSD License.
+///
+/// \note This file may become part of the mingw-w64 runtime package. If/when
+/// this happens, the appropriate license will be added, i.e. this code will
+/// become dual-licensed, and the current BSD 2-clause license will stay.
+
+//    Windows 8 introduced WaitOnAddress, which lets a thread sleep until the
+//  value of a word in its own address space changes. Synchronization objects
+//  built on it need no kernel object, no initialization, and no destruction. On
+//  older versions of Windows, the same interface is emulated with a fixed table
+//  of wait queues, which are selected by hashing the address of the word:
+//  - On Vista and Windows 7, each queue is a slim reader-writer lock with a
+//    native condition variable.
+//  - On XP, each queue is a spin-locked list of waiting threads, each of which
+//    sleeps on an event. The event is taken from a shared pool only when the
+//    thread has to sleep, and returned to the pool when it wakes.
+//    In all cases, the wait may end spuriously; callers must check the word
+//  again after waking.
+
+#ifndef MINGW_WAIT_ON_ADDRESS_H_
+#define MINGW_WAIT_ON_ADDRESS_H_
+
+#if !defined(__cplusplus) || (__cplusplus < 201103L)
+#error A C++11 compiler is required!
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>      //  For std::uint32_t
+#include <cstddef>      //  For std::size_t, std::uintptr_t
+
+#include <sdkddkver.h>  //  Detect Windows version.
+
+#if (defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
+#include <windows.h>    //  No further granularity can be expected.
+#else
+#include <synchapi.h>   //  For WaitOnAddress, SRW locks, events, etc.
+#include <handleapi.h>  //  For CloseHandle
+#include <processthreadsapi.h>  //  For SwitchToThread
+#endif
+
+//  For deadline_after
+#include "mingw.precise_sleep.h"
+
+namespace mingw_stdthread
+{
+namespace detail
+{
+constexpr DWORD kAddressWaitInfinite = 0xffffffffl;
+constexpr DWORD kAddressWaitObject0 = 0x00000000l;
+
+#if (WINVER >= _WIN32_WINNT_WIN8)
+//    Sleeps until `word` might no longer hold `compare`, or until `ms`
+//  milliseconds have passed. Returns false if the wait timed out.
+inline bool wait_on_address (std::atomic<std::uint32_t> & word,
+                             std::uint32_t compare, DWORD ms) noexcept
+{
+    return WaitOnAddress(&word, &compare, sizeof(compare), ms) != 0;
+}
+inline void wake_by_address_single (std::atomic<std::uint32_t> & word) noexcept
+{
+    WakeByAddressSingle(&word);
+}
+inline void wake_by_address_all (std::atomic<std::uint32_t> & word) noexcept
+{
+    WakeByAddressAll(&word);
+}
+#else
+//    Use a class template to allow instantiation of statics in a header-only
+//  library. The table is zero-initialized, which is a valid initial state for
+//  every queue, so it can be used during static initialization.
+template<bool>
+struct AddressWaitStatic
+{
+    static constexpr std::size_t kQueues = 256;
+#if (WINVER >= _WIN32_WINNT_VISTA)
+    struct alignas(64) Queue
+    {
+        SRWLOCK mLock;
+        CONDITION_VARIABLE mCondition;
+    };
+#else
+    static constexpr std::size_t kPooledEvents = 64;
+    struct Waiter
+    {
+        std::atomic<std::uint32_t> * mAddress;
+        HANDLE mEvent;
+        Waiter * mNext;
+    };
+    struct SpinLock
+    {
+        std::atomic<bool> mBusy;
+        void lock (void) noexcept
+        {
+            while (mBusy.exchange(true, std::memory_order_acquire))
+                SwitchToThread();
+        }
+        void unlock (void) noexcept
+        {
+            mBusy.store(false, std::memory_order_release);
+        }
+    };
+    struct alignas(64) Queue : SpinLock
+    {
+        Waiter * mHead;
+//  Returns false if the waiter was already removed by a waking thread.
+        bool remove (Waiter * waiter) noexcept
+        {
+            for (Waiter ** link = &mHead; *link != nullptr; link = &(*link)->mNext)
+                if (*link == waiter)
+                {
+                    *link = waiter->mNext;
+                    return true;
+                }
+            return false;
+        }
+    };
+//    Auto-reset events, none of them signaled, kept for reuse so that a thread
+//  does not create and close an event each time it sleeps. A thread that finds
+//  the pool empty creates a new event, and closes it if the pool is full.
+    struct EventPool : SpinLock
+    {
+        std::size_t mCount;
+        HANDLE mEvents [kPooledEvents];
+        HANDLE acquire (void) noexcept
+        {
+            HANDLE event = nullptr;
+            this->lock();
+            if (mCount != 0)
+                event = mEvents[--mCount];
+            this->unlock();
+            if (event == nullptr)
+                event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+            return event;
+        }
+        void release (HANDLE event) noexcept
+        {
+            this->lock();
+            bool pooled = (mCount < kPooledEvents);
+            if (pooled)
+                mEvents[mCount++] = event;
+            this->unlock();
+            if (!pooled)
+                CloseHandle(event);
+        }
+    };
+    static EventPool events;
+#endif
+    static Queue queues [kQueues];
+
+    static Queue & get_queue (void const * address) noexcept
+    {
+//  The low bits of a 4-byte-aligned address carry no information.
+        std::uintptr_t bits = reinterpret_cast<std::uintptr_t>(address) >> 2;
+        return queues[(bits ^ (bits >> 8)) % kQueues];
+    }
+};
+template<bool b>
+typename AddressWaitStatic<b>::Queue AddressWaitStatic<b>::queues [AddressWaitStatic<b>::kQueues];
+#if (WINVER < _WIN32_WINNT_VISTA)
+template<bool b>
+typename AddressWaitStatic<b>::EventPool AddressWaitStatic<b>::events;
+#endif
+
+#if (WINVER >= _WIN32_WINNT_VISTA)
+inline bool wait_on_address (std::atomic<std::uint32_t> & word,
+                             std::uint32_t compare, DWORD ms) noexcept
+{
+    auto & queue = AddressWaitStatic<true>::get_queue(&word);
+//    A waking thread changes the word before taking the queue's lock, so the
+//  word cannot change unnoticed between this check and the sleep.
+    AcquireSRWLockExclusive(&queue.mLock);
+    BOOL success = TRUE;
+    if (word.load(std::memory_order_relaxed) == compare)
+        success = SleepConditionVariableSRW(&queue.mCondition, &queue.mLock, ms, 0);
+    ReleaseSRWLockExclusive(&queue.mLock);
+    return success != 0;
+}
+inline void wake_by_address_all (std::atomic<std::uint32_t> & word) noexcept
+{
+    auto & queue = AddressWaitStatic<true>::get_queue(&word);
+    AcquireSRWLockExclusive(&queue.mLock);
+    ReleaseSRWLockExclusive(&queue.mLock);
+    WakeAllConditionVariable(&queue.mCondition);
+}
+//    Other words may share the queue, so waking a single thread could wake one
+//  that waits on a different word, and lose the notification.
+inline void wake_by_address_single (std::atomic<std::uint32_t> & word) noexcept
+{
+    wake_by_address_all(word);
+}
+#else
+inline bool wait_on_address (std::atomic<std::uint32_t> & word,
+                             std::uint32_t compare, DWORD ms) noexcept
+{
+    using Static = AddressWaitStatic<true>;
+    if (word.load(std::memory_order_relaxed) != compare)
+        return true;
+    Static::Waiter self { &word, Static::events.acquire(), nullptr };
+    if (self.mEvent == nullptr)
+    {
+//  Without an event, fall back to polling.
+        Sleep(0);
+        return true;
+    }
+    auto & queue = Static::get_queue(&word);
+    queue.lock();
+    if (word.load(std::memory_order_relaxed) != compare)
+    {
+        queue.unlock();
+        Static::events.release(self.mEvent);
+        return true;
+    }
+    self.mNext = queue.mHead;
+    queue.mHead = &self;
+    queue.unlock();
+    bool success = (WaitForSingleObject(self.mEvent, ms) == kAddressWaitObject0);
+    if (!success)
+    {
+        queue.lock();
+        bool removed = queue.remove(&self);
+        queue.unlock();
+//    A waking thread has already claimed this waiter, and is about to signal
+//  the event. Wait for it, so that the event goes back to the pool unsignaled.
+        if (!removed)
+        {
+            WaitForSingleObject(self.mEvent, kAddressWaitInfinite);
+            success = true;
+        }
+    }
+    Static::events.release(self.mEvent);
+    return success;
+}
+//    Waiters are pushed at the head of the list, so a single wake takes the
+//  last matching waiter, which has waited longest.
+inline void wake_by_address (std::atomic<std::uint32_t> & word, bool all) noexcept
+{
+    using Static = AddressWaitStatic<true>;
+    auto & queue = Static::get_queue(&word);
+    Static::Waiter * woken = nullptr;
+    queue.lock();
+    if (all)
+    {
+        for (Static::Waiter ** link = &queue.mHead; *link != nullptr;)
+        {
+            Static::Waiter * waiter = *link;
+            if (waiter->mAddress != &word)
+            {
+                link = &waiter->mNext;
+                continue;
+            }
+            *link = waiter->mNext;
+            waiter->mNext = woken;
+            woken = waiter;
+        }
+    }
+    else
+    {
+        Static::Waiter ** oldest = nullptr;
+        for (Static::Waiter ** link = &queue.mHead; *link != nullptr; link = &(*link)->mNext)
+            if ((*link)->mAddress == &word)
+                oldest = link;
+        if (oldest != nullptr)
+        {
+            woken = *oldest;
+            *oldest = woken->mNext;
+            woken->mNext = nullptr;
+        }
+    }
+    queue.unlock();
+//  A waiter may leave as soon as its event is set, so read its link first.
+    while (woken != nullptr)
+    {
+        Static::Waiter * next = woken->mNext;
+        SetEvent(woken->mEvent);
+        woken = next;
+    }
+}
+inline void wake_by_address_single (std::atomic<std::uint32_t> & word) noexcept
+{
+    wake_by_address(word, false);
+}
+inline void wake_by_address_all (std::atomic<std::uint32_t> & word) noexcept
+{
+    wake_by_address(word, true);
+}
+#endif
+#endif
+
+//    As wait_on_address, but returns false without sleeping if the deadline has
+//  passed. The system can only time out in whole milliseconds, so the wait is
+//  limited to the whole milliseconds that remain; the caller will then check
+//  the word again, and call this function again. Once less than a millisecond
+//  remains, yield instead of sleeping, so that short timeouts are neither
+//  truncated to zero nor stretched to a full timer tick.
+inline bool wait_on_address_until (std::atomic<std::uint32_t> & word,
+                                   std::uint32_t compare,
+                                   std::chrono::steady_clock::time_point deadline) noexcept
+{
+    using namespace std::chrono;
+    if (deadline == steady_clock::time_point::max())
+    {
+        wait_on_address(word, compare, kAddressWaitInfinite);
+        return true;
+    }
+    auto now = steady_clock::now();
+    if (now >= deadline)
+        return false;
+    auto ms = duration_cast<milliseconds>(deadline - now).count();
+    if (ms == 0)
+        Sleep(0);
+    else
+    {
+        constexpr auto kMaxStep = static_cast<decltype(ms)>(kAddressWaitInfinite - 1);
+        wait_on_address(word, compare, static_cast<DWORD>((ms < kMaxStep) ? ms : kMaxStep));
+    }
+    return true;
+}
+} //  Namespace "detail"
+} //  Namespace "mingw_stdthread"
+#endif // MINGW_WAIT_ON_ADDRESS_H_
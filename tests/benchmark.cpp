@@ -0,0 +1,522 @@
+//    Throughput and latency measurements for the synchronization primitives in
+//  this library. Unlike the tests, these use the mingw_stdthread namespace
+//  directly, so that alternative implementations can be compared side by side.
+//    Results depend heavily on the machine. Run with no arguments for the
+//  default measurement time, or pass a number of milliseconds per measurement.
+
+#include <mingw.thread.h>
+#include <mingw.mutex.h>
+#include <mingw.condition_variable.h>
+#include <mingw.future.h>
+#include <mingw.shared_mutex.h>
+#include <mingw.seqlock.h>
+#include <mingw.thread_pool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <type_traits>
+#include <vector>
+
+namespace
+{
+using namespace mingw_stdthread;
+
+std::chrono::milliseconds gMeasureTime (200);
+const unsigned kThreadCounts [] = { 2, 4, 8, 16, 32, 64 };
+
+//    Spend a little time without touching shared memory. Used both inside and
+//  outside of critical sections to model realistic lock usage.
+inline void local_work (unsigned iterations)
+{
+  for (unsigned i = 0; i < iterations; ++i)
+    YieldProcessor();
+}
+
+//    Runs `body` on `num_threads` threads for the measurement time, and returns
+//  the total number of iterations completed, in millions per second.
+template<class Body>
+double run_threads (unsigned num_threads, Body body)
+{
+  std::atomic<bool> start (false), stop (false);
+  std::atomic<unsigned long long> total (0);
+  std::vector<thread> threads;
+  for (unsigned i = 0; i < num_threads; ++i)
+    threads.push_back(thread([&, i] (void)
+      {
+        while (!start.load(std::memory_order_acquire))
+          this_thread::yield();
+        unsigned long long count = 0;
+        while (!stop.load(std::memory_order_relaxed))
+        {
+          body(i);
+          ++count;
+        }
+        total.fetch_add(count, std::memory_order_relaxed);
+      }));
+  auto begin = std::chrono::steady_clock::now();
+  start.store(true, std::memory_order_release);
+  this_thread::sleep_for(gMeasureTime);
+  stop.store(true, std::memory_order_relaxed);
+  for (thread & t : threads)
+    t.join();
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+  return total.load() / elapsed.count() / 1e6;
+}
+
+//  Short critical sections with a little work between them.
+template<class M>
+double lock_throughput (unsigned num_threads)
+{
+  M mtx;
+  unsigned long long shared_counter = 0;
+  return run_threads(num_threads, [&] (unsigned)
+    {
+      mtx.lock();
+      ++shared_counter;
+      local_work(8);
+      mtx.unlock();
+      local_work(32);
+    });
+}
+
+//  Short read-only critical sections, as on a read-mostly table.
+template<class M>
+double read_throughput (unsigned num_threads)
+{
+  M mtx;
+  std::atomic<unsigned> shared_value (0);
+  return run_threads(num_threads, [&] (unsigned)
+    {
+      mtx.lock_shared();
+      shared_value.load(std::memory_order_relaxed);
+      local_work(8);
+      mtx.unlock_shared();
+      local_work(32);
+    });
+}
+
+//    Reads a value, decides that it is stale, and replaces it. With a plain
+//  shared mutex, the writer must drop its shared lock, take the exclusive lock,
+//  and check the value again...
+template<class M>
+void check_and_write (M & mtx, std::atomic<unsigned> & value, std::false_type)
+{
+  mtx.lock_shared();
+  value.load(std::memory_order_relaxed);
+  local_work(8);
+  mtx.unlock_shared();
+  mtx.lock();
+  unsigned seen = value.load(std::memory_order_relaxed);
+  local_work(8);
+  value.store(seen + 1, std::memory_order_relaxed);
+  mtx.unlock();
+}
+
+//  ...whereas with upgrade ownership it converts its lock in place.
+template<class M>
+void check_and_write (M & mtx, std::atomic<unsigned> & value, std::true_type)
+{
+  mtx.lock_upgrade();
+  unsigned seen = value.load(std::memory_order_relaxed);
+  local_work(8);
+  mtx.unlock_upgrade_and_lock();
+  value.store(seen + 1, std::memory_order_relaxed);
+  mtx.unlock();
+}
+
+//  Read-mostly access, in which one operation in 16 may need to write.
+template<class M, bool Upgrade>
+double read_check_write (unsigned num_threads)
+{
+  struct alignas(64) Counter
+  {
+    unsigned value;
+  };
+  M mtx;
+  std::atomic<unsigned> shared_value (0);
+  std::vector<Counter> counters (num_threads);
+  return run_threads(num_threads, [&] (unsigned i)
+    {
+      if (++counters[i].value % 16 != 0)
+      {
+        mtx.lock_shared();
+        shared_value.load(std::memory_order_relaxed);
+        local_work(8);
+        mtx.unlock_shared();
+      }
+      else
+        check_and_write(mtx, shared_value, std::integral_constant<bool, Upgrade>());
+      local_work(32);
+    });
+}
+
+//    A small block of statistics, read by every thread, and updated by one
+//  thread in every operation in 256 of its own.
+struct Stats
+{
+  unsigned long long count, total, minimum, maximum;
+};
+
+template<class M>
+double shared_snapshot_throughput (unsigned num_threads)
+{
+  M mtx;
+  Stats stats {};
+  std::atomic<unsigned long long> sink (0);
+  std::vector<unsigned> counters (num_threads);
+  return run_threads(num_threads, [&] (unsigned i)
+    {
+      if ((i == 0) && (++counters[i] % 256 == 0))
+      {
+        lock_guard<M> guard (mtx);
+        ++stats.count;
+        stats.total += counters[i];
+      }
+      else
+      {
+        shared_lock<M> guard (mtx);
+        sink.store(stats.count + stats.total, std::memory_order_relaxed);
+      }
+      local_work(32);
+    });
+}
+
+double seqlock_snapshot_throughput (unsigned num_threads)
+{
+  seqlock<Stats> stats;
+  std::atomic<unsigned long long> sink (0);
+  std::vector<unsigned> counters (num_threads);
+  return run_threads(num_threads, [&] (unsigned i)
+    {
+      if ((i == 0) && (++counters[i] % 256 == 0))
+        stats.update([&] (Stats & s)
+          {
+            ++s.count;
+            s.total += counters[i];
+          });
+      else
+      {
+        Stats s = stats.load();
+        sink.store(s.count + s.total, std::memory_order_relaxed);
+      }
+      local_work(32);
+    });
+}
+
+//  Returns the value below which the fraction `p` of the sorted samples lie.
+inline float percentile (std::vector<float> const & sorted, double p)
+{
+  if (sorted.empty())
+    return 0;
+  std::size_t index = static_cast<std::size_t>(p * sorted.size());
+  return sorted[(index < sorted.size()) ? index : sorted.size() - 1];
+}
+
+//    Measures how long each acquisition waits, with one operation in
+//  `write_every` writing, and prints the 50th, 99th and 99.9th percentiles for
+//  readers and writers, in microseconds.
+template<class M>
+void acquire_latency (char const * name, unsigned num_threads, unsigned write_every)
+{
+  using namespace std::chrono;
+  struct alignas(64) Samples
+  {
+    std::vector<float> reads, writes;
+    unsigned count = 0;
+  };
+  M mtx;
+  std::atomic<unsigned> shared_value (0);
+  std::vector<Samples> samples (num_threads);
+  run_threads(num_threads, [&] (unsigned i)
+    {
+      Samples & mine = samples[i];
+      bool write = (++mine.count % write_every == 0);
+      auto start = steady_clock::now();
+      if (write)
+        mtx.lock();
+      else
+        mtx.lock_shared();
+      float waited = duration<float, std::micro>(steady_clock::now() - start).count();
+      local_work(8);
+      if (write)
+      {
+        shared_value.store(mine.count, std::memory_order_relaxed);
+        mtx.unlock();
+        mine.writes.push_back(waited);
+      }
+      else
+      {
+        shared_value.load(std::memory_order_relaxed);
+        mtx.unlock_shared();
+        mine.reads.push_back(waited);
+      }
+      local_work(32);
+    });
+  std::vector<float> reads, writes;
+  for (Samples const & s : samples)
+  {
+    reads.insert(reads.end(), s.reads.begin(), s.reads.end());
+    writes.insert(writes.end(), s.writes.begin(), s.writes.end());
+  }
+  std::sort(reads.begin(), reads.end());
+  std::sort(writes.begin(), writes.end());
+  std::printf("%26s  %9.2f %9.2f %9.2f  %9.2f %9.2f %9.2f\n", name,
+              percentile(reads, 0.5), percentile(reads, 0.99), percentile(reads, 0.999),
+              percentile(writes, 0.5), percentile(writes, 0.99), percentile(writes, 0.999));
+}
+
+//    Pairs of threads pass a turn back and forth, each waiting on the pair's
+//  condition variable until the other hands the turn over, so every operation
+//  is one notification and one wait. Returns millions of handoffs per second.
+template<class CV, class M>
+double handoff_throughput (unsigned num_threads)
+{
+  struct alignas(64) Pair
+  {
+    M mtx;
+    CV cv;
+    unsigned turn = 0;
+    bool stop = false;
+    unsigned long long count = 0;
+  };
+  unsigned num_pairs = (num_threads + 1) / 2;
+  std::vector<Pair> pairs (num_pairs);
+  std::vector<thread> threads;
+  for (unsigned i = 0; i < 2 * num_pairs; ++i)
+    threads.push_back(thread([&pairs, i] (void)
+      {
+        Pair & pair = pairs[i / 2];
+        unsigned side = i % 2;
+        unique_lock<M> lock (pair.mtx);
+        for (;;)
+        {
+          pair.cv.wait(lock, [&pair, side] { return pair.stop || (pair.turn == side); });
+          if (pair.stop)
+            return;
+          pair.turn = 1 - side;
+          ++pair.count;
+          pair.cv.notify_one();
+        }
+      }));
+  auto begin = std::chrono::steady_clock::now();
+  this_thread::sleep_for(gMeasureTime);
+  unsigned long long total = 0;
+  for (Pair & pair : pairs)
+  {
+    lock_guard<M> guard (pair.mtx);
+    pair.stop = true;
+    total += pair.count;
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+  for (Pair & pair : pairs)
+    pair.cv.notify_all();
+  for (thread & t : threads)
+    t.join();
+  return total / elapsed.count() / 1e6;
+}
+
+//    Each thread launches a trivial task and waits for its result, so that
+//  the cost of launching dominates. Returns thousands of calls per second.
+template<launch Policy>
+double async_throughput (unsigned num_threads)
+{
+  return 1e3 * run_threads(num_threads, [] (unsigned i)
+    {
+      async(Policy, [] (unsigned x) { return x + 1; }, i).get();
+    });
+}
+
+//    Each thread submits a batch of trivial tasks, then waits for all of them.
+//  The async pool takes every task from one locked queue; thread_pool spreads
+//  them over a deque per worker. Returns thousands of tasks per second.
+template<class Submit>
+double batch_throughput (unsigned num_threads, Submit submit)
+{
+  constexpr unsigned kBatch = 16;
+  return 1e3 * kBatch * run_threads(num_threads, [&] (unsigned i)
+    {
+      future<unsigned> results [kBatch];
+      for (unsigned j = 0; j < kBatch; ++j)
+        results[j] = submit(i + j);
+      for (future<unsigned> & result : results)
+        result.get();
+    });
+}
+
+double async_pool_batches (unsigned num_threads)
+{
+  return batch_throughput(num_threads, [] (unsigned x)
+    {
+      return async(launch_pooled, [] (unsigned y) { return y + 1; }, x);
+    });
+}
+
+double thread_pool_batches (unsigned num_threads)
+{
+  static thread_pool pool;
+  return batch_throughput(num_threads, [] (unsigned x)
+    {
+      return pool.submit([] (unsigned y) { return y + 1; }, x);
+    });
+}
+
+struct Candidate
+{
+  char const * name;
+  double (*measure) (unsigned num_threads);
+};
+
+//  Prints one row per thread count, and one column per candidate.
+template<std::size_t N>
+void compare (char const * title, Candidate const (&candidates) [N],
+              char const * unit = "millions of operations per second")
+{
+  std::printf("\n%s (%s)\n%8s", title, unit, "threads");
+  for (Candidate const & c : candidates)
+    std::printf("  %26s", c.name);
+  std::printf("\n");
+  for (unsigned n : kThreadCounts)
+  {
+    std::printf("%8u", n);
+    for (Candidate const & c : candidates)
+      std::printf("  %26.3f", c.measure(n));
+    std::printf("\n");
+  }
+}
+
+void benchmark_mutexes (void)
+{
+  Candidate const candidates [] = {
+    { "xp::mutex", &lock_throughput<xp::mutex> },
+#if (WINVER >= _WIN32_WINNT_WIN7)
+    { "windows7::mutex", &lock_throughput<windows7::mutex> },
+    { "windows7::adaptive_mutex", &lock_throughput<windows7::adaptive_mutex> },
+#endif
+#if (WINVER >= _WIN32_WINNT_WIN8)
+    { "windows8::mutex", &lock_throughput<windows8::mutex> },
+#endif
+    { "checked_mutex", &lock_throughput<checked_mutex> },
+    { "queue_mutex", &lock_throughput<queue_mutex> },
+  };
+  compare("Mutex throughput", candidates);
+}
+
+void benchmark_shared_mutexes (void)
+{
+  Candidate const candidates [] = {
+    { "portable::shared_mutex", &read_throughput<portable::shared_mutex> },
+#if (WINVER >= _WIN32_WINNT_WIN7)
+    { "windows7::shared_mutex", &read_throughput<windows7::shared_mutex> },
+#endif
+    { "distributed_shared_mutex", &read_throughput<distributed_shared_mutex> },
+    { "phase_fair_shared_mutex", &read_throughput<phase_fair_shared_mutex> },
+  };
+  compare("Shared lock read throughput", candidates);
+}
+
+//    The cost of a wait, compared between the native condition variable, the
+//  condition_variable_any built on it, and the sequence-based condition
+//  variables, each with the mutexes it can sleep on.
+void benchmark_condition_variables (void)
+{
+  Candidate const candidates [] = {
+#if (WINVER >= _WIN32_WINNT_VISTA)
+#if (WINVER >= _WIN32_WINNT_WIN8) && !defined(MINGW_STDTHREADS_ADAPTIVE_MUTEX)
+    { "vista::cv, windows7", &handoff_throughput<vista::condition_variable, windows7::mutex> },
+#endif
+    { "vista::cv_any, windows7", &handoff_throughput<vista::condition_variable_any, windows7::mutex> },
+    { "vista::cv_any, queue_mutex", &handoff_throughput<vista::condition_variable_any, queue_mutex> },
+#endif
+#if (WINVER >= _WIN32_WINNT_WIN8)
+    { "windows8::cv, mutex", &handoff_throughput<windows8::condition_variable, mutex> },
+    { "windows8::cv_any, windows7", &handoff_throughput<windows8::condition_variable_any, windows7::mutex> },
+    { "windows8::cv_any, windows8", &handoff_throughput<windows8::condition_variable_any, windows8::mutex> },
+    { "windows8::cv_any, queue", &handoff_throughput<windows8::condition_variable_any, queue_mutex> },
+#endif
+#if (WINVER < _WIN32_WINNT_VISTA)
+    { "xp::cv_any, xp::mutex", &handoff_throughput<xp::condition_variable_any, xp::mutex> },
+    { "xp::cv_any, queue_mutex", &handoff_throughput<xp::condition_variable_any, queue_mutex> },
+#endif
+  };
+  compare("Condition variable handoffs", candidates);
+}
+
+void benchmark_async (void)
+{
+  Candidate const candidates [] = {
+#if defined(MINGW_STDTHREADS_ASYNC_POOL)
+    { "launch::async (pooled)", &async_throughput<launch::async> },
+#else
+    { "launch::async", &async_throughput<launch::async> },
+#endif
+    { "launch_pooled", &async_throughput<launch_pooled> },
+  };
+  compare("Async throughput", candidates, "thousands of calls per second");
+}
+
+void benchmark_task_pools (void)
+{
+  Candidate const candidates [] = {
+    { "launch_pooled", &async_pool_batches },
+    { "thread_pool", &thread_pool_batches },
+  };
+  compare("Task batch throughput", candidates, "thousands of tasks per second");
+}
+
+void benchmark_latency (void)
+{
+  static constexpr unsigned kThreads = 8;
+  for (unsigned write_every : { 2u, 10u, 100u })
+  {
+    std::printf("\nAcquire latency at %u threads, 1 write in %u operations (microseconds)\n"
+                "%26s  %9s %9s %9s  %9s %9s %9s\n", kThreads, write_every, "",
+                "read p50", "p99", "p99.9", "write p50", "p99", "p99.9");
+#if (WINVER >= _WIN32_WINNT_WIN7)
+    acquire_latency<windows7::shared_mutex>("windows7::shared_mutex", kThreads, write_every);
+#endif
+    acquire_latency<portable::shared_mutex>("portable::shared_mutex", kThreads, write_every);
+    acquire_latency<phase_fair_shared_mutex>("phase_fair_shared_mutex", kThreads, write_every);
+  }
+}
+
+void benchmark_snapshots (void)
+{
+  Candidate const candidates [] = {
+    { "shared_mutex", &shared_snapshot_throughput<shared_mutex> },
+    { "distributed_shared_mutex", &shared_snapshot_throughput<distributed_shared_mutex> },
+    { "seqlock", &seqlock_snapshot_throughput },
+  };
+  compare("Snapshot read throughput", candidates);
+}
+
+void benchmark_upgrade (void)
+{
+  Candidate const candidates [] = {
+    { "shared_mutex, relock", &read_check_write<shared_mutex, false> },
+    { "upgrade_mutex, relock", &read_check_write<upgrade_mutex, false> },
+    { "upgrade_mutex, upgrade", &read_check_write<upgrade_mutex, true> },
+  };
+  compare("Read-check-write throughput", candidates);
+}
+} //  Namespace
+
+int main (int argc, char ** argv)
+{
+  if (argc > 1)
+    gMeasureTime = std::chrono::milliseconds(std::atoi(argv[1]));
+  std::printf("Measuring for %lld ms per data point, on %u hardware threads.\n",
+              static_cast<long long>(gMeasureTime.count()),
+              thread::hardware_concurrency());
+  benchmark_mutexes();
+  benchmark_shared_mutexes();
+  benchmark_snapshots();
+  benchmark_upgrade();
+  benchmark_condition_variables();
+  benchmark_async();
+  benchmark_task_pools();
+  benchmark_latency();
+  return 0;
+}
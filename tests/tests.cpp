@@ -21,11 +21,29 @@
   #endif
 
 #endif
+//  Not part of the standard library.
+#include <mingw.lock_table.h>
+#include <mingw.seqlock.h>
+#include <mingw.thread_pool.h>
+#include <mingw.io_executor.h>
+#if (defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
+#include <windows.h>
+#else
+#include <namedpipeapi.h>   //  For CreateNamedPipeW
+#endif
+
 #include <atomic>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <cwchar>       //  For std::wcscmp
+#include <functional>
+#include <new>          //  For placement new
+#include <stdexcept>
 #include <string>
 #include <iostream>
 #include <typeinfo>
+#include <vector>
 
 using namespace std;
 
@@ -79,6 +97,78 @@ struct TestMove
     }
 };
 
+//    A thread created with attributes must start suspended when asked to, and
+//  must run with the requested priority, stack reservation and name. The name
+//  can only be read back where GetThreadDescription exists (Windows 10, version
+//  1607). A priority that cannot be set must keep the function from running.
+void test_thread_attributes (void)
+{
+  using mingw_stdthread::thread;
+  typedef long (__stdcall * GetDescriptionFunc)(HANDLE, wchar_t **);
+  auto get_description = reinterpret_cast<GetDescriptionFunc>(
+      reinterpret_cast<void (*)()>(GetProcAddress(GetModuleHandleW(L"kernel32.dll"),
+                                                  "GetThreadDescription")));
+  thread::attributes attrs;
+  attrs.stack_size = 64 * 1024;
+  attrs.priority = -1;  //  THREAD_PRIORITY_BELOW_NORMAL
+  attrs.name = L"attributes test";
+  attrs.suspended = true;
+  std::atomic<bool> started (false);
+  int priority = 0;
+  std::size_t reserved = 0;
+  bool named = true;
+  thread t (attrs, [&] (void)
+    {
+      started = true;
+      priority = GetThreadPriority(GetCurrentThread());
+//  The stack is one reservation; add up its regions, starting from its base.
+      MEMORY_BASIC_INFORMATION info;
+      if (VirtualQuery(&info, &info, sizeof(info)) != 0)
+      {
+        void * base = info.AllocationBase;
+        char * region = static_cast<char *>(base);
+        while ((VirtualQuery(region, &info, sizeof(info)) != 0) &&
+               (info.AllocationBase == base))
+        {
+          reserved += info.RegionSize;
+          region += info.RegionSize;
+        }
+      }
+      wchar_t * description = nullptr;
+      if ((get_description != nullptr) &&
+          (get_description(GetCurrentThread(), &description) >= 0))
+      {
+        named = (std::wcscmp(description, L"attributes test") == 0);
+        LocalFree(description);
+      }
+    });
+  this_thread::sleep_for(std::chrono::milliseconds(50));
+  if (started)
+    log_error("A thread created suspended ran before it was resumed.");
+  ResumeThread(t.native_handle());
+  t.join();
+  if (!started)
+    log_error("A thread created with attributes did not run.");
+  if (priority != -1)
+    log_error("A thread created with attributes ran at priority %d instead of -1.", priority);
+  if ((reserved < 64 * 1024) || (reserved >= 1024 * 1024))
+    log_error("A thread created with attributes reserved %zu bytes of stack instead of 64 KiB.", reserved);
+  if (!named)
+    log_error("A thread created with attributes was not given its name.");
+
+  attrs = thread::attributes();
+  attrs.priority = 1000;
+  bool called = false;
+  try {
+    thread refused (attrs, [&called] (void) { called = true; });
+    refused.join();
+    log_error("A thread was created with an invalid priority.");
+  } catch (std::system_error const &) {
+  }
+  if (called)
+    log_error("A thread whose priority could not be set ran its function.");
+}
+
 template<class T>
 void test_future_set_value (promise<T> & promise)
 {
@@ -303,6 +393,157 @@ void test_future ()
   test_future_get_value(async_member);
 }
 
+//    Pooled tasks that wait for other pooled tasks must finish even when they
+//  outnumber the workers, since a worker that waits for a future makes room for
+//  another.
+void test_async_pool (void)
+{
+  using mingw_stdthread::launch_pooled;
+  unsigned const count = 4 * thread::hardware_concurrency() + 4;
+  vector<future<unsigned> > outer;
+  for (unsigned i = 0; i < count; ++i)
+    outer.push_back(async(launch_pooled, [] (unsigned value) -> unsigned
+      {
+        return async(launch_pooled, [] (unsigned inner) { return inner + 1; }, value).get();
+      }, i));
+  for (unsigned i = 0; i < count; ++i)
+    if (outer[i].get() != i + 1)
+      log_error("Pooled task %u returned the wrong value.", i);
+  auto failing = async(launch_pooled, [] (void) -> int
+    {
+      throw std::runtime_error("Pooled task failed, as expected.");
+    });
+  try {
+    failing.get();
+    log_error("A pooled task's exception was not passed to its future.");
+  } catch (std::runtime_error const &) {
+  }
+}
+
+//    Tasks submitted by tasks go to the deque of their worker, and are stolen
+//  from there by the others; wait_idle must wait for those as well.
+void test_thread_pool (void)
+{
+  using mingw_stdthread::thread_pool;
+  thread_pool pool (4);
+  if (pool.size() != 4)
+    log_error("thread_pool has %u workers instead of 4.", unsigned(pool.size()));
+  vector<future<unsigned> > results;
+  for (unsigned i = 0; i < 1000; ++i)
+    results.push_back(pool.submit([] (unsigned value) { return value * 2; }, i));
+  for (unsigned i = 0; i < 1000; ++i)
+    if (results[i].get() != i * 2)
+      log_error("thread_pool task %u returned the wrong value.", i);
+  atomic<unsigned> leaves (0);
+  function<void(unsigned)> split;
+  split = [&] (unsigned depth)
+    {
+      if (depth == 0)
+        ++leaves;
+      else
+      {
+        pool.submit(split, depth - 1);
+        pool.submit(split, depth - 1);
+      }
+    };
+  pool.submit(split, 10u);
+  pool.wait_idle();
+  if (leaves.load() != 1024)
+    log_error("thread_pool::wait_idle returned after %u of 1024 tasks.", leaves.load());
+  auto failing = pool.submit([] (void) -> int
+    {
+      throw std::runtime_error("thread_pool task failed, as expected.");
+    });
+  try {
+    failing.get();
+    log_error("A thread_pool task's exception was not passed to its future.");
+  } catch (std::runtime_error const &) {
+  }
+  auto nested_wait = pool.submit([&pool] (void) -> bool
+    {
+      try {
+        pool.wait_idle();
+      } catch (std::system_error const &) {
+        return true;
+      }
+      return false;
+    });
+  if (!nested_wait.get())
+    log_error("thread_pool::wait_idle did not refuse to wait within a task.");
+}
+
+//    Reads and writes a temporary file and a named pipe through the port, so
+//  that the test also runs under Wine.
+void test_io_executor (void)
+{
+  using mingw_stdthread::io_executor;
+  io_executor executor (2);
+  auto elsewhere = executor.post([] (thread::id caller) { return this_thread::get_id() != caller; },
+                                 this_thread::get_id());
+  if (!elsewhere.get())
+    log_error("io_executor ran a posted task on the posting thread.");
+
+  char const message [] = "completed through the port";
+  char buffer [64] = {};
+  wchar_t directory [MAX_PATH + 1], path [MAX_PATH + 1];
+  if ((GetTempPathW(MAX_PATH + 1, directory) == 0) || (GetTempFileNameW(directory, L"mst", 0, path) == 0))
+  {
+    log_error("Could not name a temporary file for io_executor.");
+    return;
+  }
+  HANDLE file = CreateFileW(path, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                            FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE | FILE_FLAG_OVERLAPPED,
+                            nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+  {
+    log_error("Could not create a temporary file for io_executor.");
+    return;
+  }
+  executor.associate(file);
+  if (executor.write(file, message, sizeof(message), 4).get() != sizeof(message))
+    log_error("io_executor wrote the wrong number of bytes to a file.");
+  if ((executor.read(file, buffer, sizeof(buffer), 4).get() != sizeof(message)) ||
+      (std::memcmp(buffer, message, sizeof(message)) != 0))
+    log_error("io_executor did not read back what it wrote to a file.");
+  if (executor.read(file, buffer, sizeof(buffer), 4096).get() != 0)
+    log_error("io_executor read bytes past the end of a file.");
+  CloseHandle(file);
+
+  wstring name = L"\\\\.\\pipe\\mingw-stdthreads-test-";
+  for (DWORD id = GetCurrentProcessId(); id != 0; id /= 10)
+    name += wchar_t(L'0' + id % 10);
+  HANDLE server = CreateNamedPipeW(name.c_str(), PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED |
+                                   FILE_FLAG_FIRST_PIPE_INSTANCE, PIPE_TYPE_BYTE | PIPE_WAIT, 1,
+                                   4096, 4096, 0, nullptr);
+  HANDLE client = (server == INVALID_HANDLE_VALUE) ? INVALID_HANDLE_VALUE :
+      CreateFileW(name.c_str(), GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, nullptr);
+  if (client == INVALID_HANDLE_VALUE)
+  {
+    log_error("Could not create a named pipe for io_executor.");
+    if (server != INVALID_HANDLE_VALUE)
+      CloseHandle(server);
+    return;
+  }
+  executor.associate(server);
+  executor.associate(client);
+//  The read is pending until the other end writes.
+  auto received = executor.read(server, buffer, sizeof(buffer));
+  if (executor.write(client, "ping", 4).get() != 4)
+    log_error("io_executor wrote the wrong number of bytes to a pipe.");
+  if ((received.get() != 4) || (std::memcmp(buffer, "ping", 4) != 0))
+    log_error("io_executor did not read what was written to a pipe.");
+  auto refused = executor.write(server, "pong", 4);
+  try {
+    refused.get();
+    log_error("io_executor wrote to the reading end of a pipe.");
+  } catch (std::system_error const &) {
+  }
+  CloseHandle(client);
+  if (executor.read(server, buffer, sizeof(buffer)).get() != 0)
+    log_error("io_executor read bytes from a closed pipe.");
+  CloseHandle(server);
+}
+
 #if defined(__cplusplus) && (__cplusplus >= 202002L)
 
 void test_latch ()
@@ -353,6 +594,821 @@ void test_latch_noexcept()
 
 #endif // defined(__cplusplus) && (__cplusplus >= 202002L)
 
+//    Hammer a Lockable from several threads at once. Lost increments mean that
+//  the lock failed to provide mutual exclusion.
+template<class M>
+void test_mutual_exclusion (char const * name)
+{
+  static constexpr int kThreads = 4;
+  static constexpr int kIterations = 20000;
+  M mtx;
+  int counter = 0;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; ++i)
+    threads.push_back(std::thread([&mtx, &counter] (void)
+      {
+        for (int j = 0; j < kIterations; ++j)
+        {
+          lock_guard<M> guard(mtx);
+          ++counter;
+        }
+      }));
+  for (std::thread & thr : threads)
+    thr.join();
+  if (counter != kThreads * kIterations)
+    log_error("%s lost updates: counted %d of %d.", name, counter, kThreads * kIterations);
+  else
+    log("\t%s provides mutual exclusion.", name);
+}
+
+//    Readers must never see a write in progress, and writers must exclude each
+//  other, while readers share the mutex.
+template<class M>
+void test_shared_exclusion (char const * name)
+{
+  static constexpr int kReaders = 3;
+  static constexpr int kWriters = 2;
+  static constexpr int kIterations = 10000;
+  M mtx;
+  int first = 0, second = 0;
+  std::atomic<bool> torn (false);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kWriters; ++i)
+    threads.push_back(std::thread([&] (void)
+      {
+        for (int j = 0; j < kIterations; ++j)
+        {
+          lock_guard<M> guard(mtx);
+          ++first;
+          this_thread::yield();
+          ++second;
+        }
+      }));
+  for (int i = 0; i < kReaders; ++i)
+    threads.push_back(std::thread([&] (void)
+      {
+        for (int j = 0; j < kIterations; ++j)
+        {
+          shared_lock<M> guard(mtx);
+          if (first != second)
+            torn = true;
+        }
+      }));
+  for (std::thread & thr : threads)
+    thr.join();
+  if (torn || (first != kWriters * kIterations))
+    log_error("%s let a reader see a partial write, or lost a write.", name);
+  else
+    log("\t%s separates readers from writers.", name);
+}
+
+//    Once a writer waits, new readers must wait behind it, so that a steady
+//  stream of readers cannot starve writers.
+template<class M>
+void test_writer_preference (char const * name)
+{
+  M mtx;
+  mtx.lock_shared();
+  std::atomic<bool> written (false);
+  std::thread writer([&mtx, &written] (void)
+    {
+      lock_guard<M> guard(mtx);
+      written = true;
+    });
+  this_thread::sleep_for(std::chrono::milliseconds(20));
+  if (mtx.try_lock_shared())
+  {
+    log_error("%s let a reader overtake a waiting writer.", name);
+    mtx.unlock_shared();
+  }
+  mtx.unlock_shared();
+  writer.join();
+  if (!written)
+    log_error("%s did not admit the writer.", name);
+}
+
+//    A timed wait on a held mutex must fail, but only once its timeout has
+//  passed, even when the timeout is shorter than a millisecond.
+template<class M>
+void test_timed_lock (char const * name)
+{
+  using namespace std::chrono;
+  M mtx;
+  mtx.lock();
+  std::thread waiter([&mtx, name] (void)
+    {
+      for (microseconds timeout : { microseconds(500), microseconds(20000) })
+      {
+        auto start = steady_clock::now();
+        bool locked = mtx.try_lock_for(timeout);
+        auto elapsed = steady_clock::now() - start;
+        if (locked)
+          log_error("%s was locked twice.", name);
+        else if (elapsed < timeout)
+          log_error("%s timed out after %lld us instead of %lld us.", name,
+                    static_cast<long long>(duration_cast<microseconds>(elapsed).count()),
+                    static_cast<long long>(timeout.count()));
+      }
+      if (!mtx.try_lock_for(seconds(10)))
+        log_error("%s was not handed over after being unlocked.", name);
+      else
+        mtx.unlock();
+    });
+  std::this_thread::sleep_for(milliseconds(50));
+  mtx.unlock();
+  waiter.join();
+  log("\t%s honors short timeouts.", name);
+}
+
+//    Upgrade ownership must admit readers, but not a second upgrading thread,
+//  and the conversions must not let a writer in between: each thread below
+//  reads the counter with upgrade ownership, and writes back that value plus
+//  one, so any writer slipping in would lose an update.
+void test_upgrade_mutex (void)
+{
+  using mingw_stdthread::upgrade_mutex;
+  using mingw_stdthread::upgrade_lock;
+  static constexpr int kThreads = 4;
+  static constexpr int kIterations = 5000;
+  upgrade_mutex mtx;
+  {
+    upgrade_lock<upgrade_mutex> check (mtx);
+    std::thread([&mtx] (void)
+      {
+        if (mtx.try_lock_upgrade())
+          log_error("upgrade_mutex granted upgrade ownership twice.");
+        if (mtx.try_lock())
+          log_error("upgrade_mutex granted exclusive ownership to a writer.");
+        if (!mtx.try_lock_shared())
+          log_error("upgrade_mutex kept a reader out of upgrade ownership.");
+        else if (mtx.try_unlock_shared_and_lock())
+          log_error("upgrade_mutex upgraded a reader past another owner.");
+        else
+          mtx.unlock_shared();
+      }).join();
+  }
+  int first = 0, second = 0;
+  std::atomic<bool> torn (false);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; ++i)
+    threads.push_back(std::thread([&] (void)
+      {
+        for (int j = 0; j < kIterations; ++j)
+        {
+          mtx.lock_upgrade();
+          int seen = first;
+          this_thread::yield();
+          mtx.unlock_upgrade_and_lock();
+          first = seen + 1;
+          this_thread::yield();
+          second = seen + 1;
+          mtx.unlock_and_lock_shared();
+          if (first != second)
+            torn = true;
+          mtx.unlock_shared();
+        }
+      }));
+  threads.push_back(std::thread([&] (void)
+    {
+      for (int j = 0; j < kIterations; ++j)
+      {
+        shared_lock<upgrade_mutex> guard(mtx);
+        if (first != second)
+          torn = true;
+      }
+    }));
+  for (std::thread & thr : threads)
+    thr.join();
+  if (torn || (first != kThreads * kIterations))
+    log_error("upgrade_mutex let a writer in during a conversion.");
+  else
+    log("\tupgrade_mutex converts ownership atomically.");
+}
+
+//    A long timed wait must sleep until the mutex is released or the deadline
+//  passes, rather than poll the mutex until then. Three waits may use a tenth
+//  of one wait's length in processor time between them: enough for the spin
+//  through each deadline's last millisecond, and for the 15.6 ms granularity of
+//  the thread times, but far less than polling with Sleep(1) or yield costs.
+void test_timed_wait_cpu (void)
+{
+  using namespace std::chrono;
+  static constexpr milliseconds kWait (300);
+  static constexpr milliseconds kBudget (kWait / 10);
+  shared_timed_mutex mtx;
+  mtx.lock();
+  std::thread waiter([&mtx] (void)
+    {
+      auto cpu_time = [] (void)
+        {
+          FILETIME creation, exited, kernel, user;
+          GetThreadTimes(GetCurrentThread(), &creation, &exited, &kernel, &user);
+          auto ticks = [] (FILETIME const & t)
+            {
+              return (static_cast<unsigned long long>(t.dwHighDateTime) << 32) | t.dwLowDateTime;
+            };
+          return duration<unsigned long long, std::ratio<1, 10000000> >(ticks(kernel) + ticks(user));
+        };
+      auto before = cpu_time();
+      if (mtx.try_lock_for(kWait))
+        log_error("shared_timed_mutex was locked twice.");
+      if (mtx.try_lock_shared_for(kWait))
+        log_error("shared_timed_mutex admitted a reader while locked.");
+      shared_lock<shared_timed_mutex> guard (mtx, defer_lock);
+      if (guard.try_lock_for(kWait))
+        log_error("shared_lock acquired a locked shared_timed_mutex.");
+      auto used = duration_cast<milliseconds>(cpu_time() - before);
+      if (used > kBudget)
+        log_error("Timed waits totalling %lld ms used %lld ms of processor time, more than %lld ms.",
+                  static_cast<long long>(3 * kWait.count()),
+                  static_cast<long long>(used.count()),
+                  static_cast<long long>(kBudget.count()));
+      else
+        log("\tTimed waits on shared_timed_mutex sleep.");
+    });
+  waiter.join();
+  mtx.unlock();
+}
+
+//    Readers of a seqlock must only ever see values that some writer stored,
+//  never a mix of two, and concurrent updates must not be lost.
+void test_seqlock (void)
+{
+  struct Snapshot
+  {
+    unsigned long long count, inverse, triple;
+  };
+  static constexpr int kWriters = 2;
+  static constexpr int kReaders = 2;
+  static constexpr int kIterations = 20000;
+  mingw_stdthread::seqlock<Snapshot> value (Snapshot { 0, ~0ull, 0 });
+  std::atomic<bool> torn (false);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kWriters; ++i)
+    threads.push_back(std::thread([&value] (void)
+      {
+        for (int j = 0; j < kIterations; ++j)
+          value.update([] (Snapshot & s)
+            {
+              ++s.count;
+              s.inverse = ~s.count;
+              s.triple = s.count * 3;
+            });
+      }));
+  for (int i = 0; i < kReaders; ++i)
+    threads.push_back(std::thread([&value, &torn] (void)
+      {
+        for (int j = 0; j < kIterations; ++j)
+        {
+          Snapshot s = value.load();
+          if ((s.inverse != ~s.count) || (s.triple != s.count * 3))
+            torn = true;
+        }
+      }));
+  for (std::thread & thr : threads)
+    thr.join();
+  if (torn)
+    log_error("seqlock let a reader see a partial write.");
+  else if (value.load().count != kWriters * kIterations)
+    log_error("seqlock lost updates: counted %llu of %d.", value.load().count,
+              kWriters * kIterations);
+  else
+    log("\tseqlock readers see whole values.");
+}
+
+//    condition_variable_any must release a recursive_mutex entirely while it
+//  waits, however deeply the waiter had entered it, and restore the depth after.
+//  It must also accept a bare mutex, and a shared lock, as the lock.
+void test_condition_variable_any_locks (void)
+{
+  using namespace std::chrono;
+  condition_variable_any cv;
+  bool ready = false;
+  recursive_mutex rmtx;
+  std::atomic<bool> waiting (false);
+  std::thread waiter([&] (void)
+    {
+      lock_guard<recursive_mutex> outer (rmtx);
+      unique_lock<recursive_mutex> inner (rmtx);
+      waiting = true;
+      if (!cv.wait_for(inner, seconds(10), [&ready] { return ready; }))
+        log_error("condition_variable_any kept a recursive_mutex locked while waiting.");
+    });
+  while (!waiting)
+    this_thread::yield();
+  {
+    lock_guard<recursive_mutex> guard (rmtx);
+    ready = true;
+  }
+  cv.notify_all();
+  waiter.join();
+  if (!rmtx.try_lock())
+    log_error("recursive_mutex stayed locked after a wait on condition_variable_any.");
+  else
+    rmtx.unlock();
+
+  mutex mtx;
+  ready = false;
+  std::thread bare_waiter([&] (void)
+    {
+      lock_guard<mutex> guard (mtx);
+      while (!ready)
+        cv.wait(mtx);
+    });
+  this_thread::sleep_for(milliseconds(20));
+  {
+    lock_guard<mutex> guard (mtx);
+    ready = true;
+  }
+  cv.notify_all();
+  bare_waiter.join();
+
+  shared_mutex smtx;
+  ready = false;
+  std::thread shared_waiter([&] (void)
+    {
+      shared_lock<shared_mutex> guard (smtx);
+      cv.wait(guard, [&ready] { return ready; });
+    });
+  this_thread::sleep_for(milliseconds(20));
+  {
+    lock_guard<shared_mutex> guard (smtx);
+    ready = true;
+  }
+  cv.notify_all();
+  shared_waiter.join();
+  log("\tcondition_variable_any releases recursive, bare and shared locks.");
+}
+
+//    Sleeps must not end before their deadlines, including deadlines a fraction
+//  of a millisecond away, and deadlines on the system clock.
+void test_sleep_deadlines (void)
+{
+  using namespace std::chrono;
+  for (microseconds wait : { microseconds(200), microseconds(1500), microseconds(20000) })
+  {
+    auto start = steady_clock::now();
+    this_thread::sleep_for(wait);
+    auto slept = duration_cast<microseconds>(steady_clock::now() - start);
+    if (slept < wait)
+      log_error("sleep_for(%lld us) returned after %lld us.",
+                static_cast<long long>(wait.count()),
+                static_cast<long long>(slept.count()));
+    auto deadline = system_clock::now() + wait;
+    this_thread::sleep_until(deadline);
+    if (system_clock::now() < deadline)
+      log_error("sleep_until(system_clock) returned early.");
+  }
+  log("\tsleep_for and sleep_until return no earlier than their deadlines.");
+}
+
+//    A timed wait that nobody notifies must not time out before its deadline,
+//  whether the deadline is a fraction of a millisecond or several away, and
+//  whichever clock it is measured on.
+template<class CV>
+void test_condition_variable_deadlines (char const * name)
+{
+  using namespace std::chrono;
+  CV cv;
+  mutex mtx;
+  unique_lock<mutex> lock (mtx);
+  for (microseconds wait : { microseconds(200), microseconds(1500), microseconds(20000) })
+  {
+    auto start = steady_clock::now();
+    if (cv.wait_for(lock, wait) == cv_status::timeout)
+    {
+      auto waited = duration_cast<microseconds>(steady_clock::now() - start);
+      if (waited < wait)
+        log_error("%s::wait_for(%lld us) timed out after %lld us.", name,
+                  static_cast<long long>(wait.count()),
+                  static_cast<long long>(waited.count()));
+    }
+    auto deadline = system_clock::now() + wait;
+    if ((cv.wait_until(lock, deadline) == cv_status::timeout) &&
+        (system_clock::now() < deadline))
+      log_error("%s::wait_until(system_clock) timed out early.", name);
+    start = steady_clock::now();
+    if (cv.wait_for(lock, wait, [] { return false; }))
+      log_error("%s::wait_for returned true with a false predicate.", name);
+    else if (steady_clock::now() - start < wait)
+      log_error("%s::wait_for with a predicate timed out early.", name);
+  }
+  log("\t%s times out no earlier than its deadline.", name);
+}
+
+//    The sequence-based condition variables own no kernel object, so their
+//  native handle is the sequence itself. Notifying only advances the sequence
+//  and wakes its address: notify_one and notify_all must return even while
+//  every waiter is suspended, and notify_one must wake one of several waiters.
+template<class CV>
+void test_sequence_condition_variable (char const * name)
+{
+  using namespace std::chrono;
+  static_assert(std::is_same<typename CV::native_handle_type,
+                             std::atomic<std::uint32_t> *>::value,
+                "A sequence condition variable should expose its sequence.");
+  constexpr int kWaiters = 4;
+  CV cv;
+  auto handle = reinterpret_cast<std::uintptr_t>(cv.native_handle());
+  auto self = reinterpret_cast<std::uintptr_t>(&cv);
+  if ((handle < self) || (handle >= self + sizeof(CV)))
+    log_error("%s::native_handle does not point into the object.", name);
+
+  mutex mtx;
+  int waiting = 0, returns = 0;
+  bool done = false;
+  std::vector<thread> waiters;
+  for (int i = 0; i < kWaiters; ++i)
+    waiters.emplace_back([&] {
+        unique_lock<mutex> lock (mtx);
+        ++waiting;
+        while (!done)
+        {
+          cv.wait(lock);
+          ++returns;
+        }
+      });
+//  Once a waiter has counted itself, it holds the mutex until it sleeps.
+  auto until = [&] (std::function<bool(void)> pred) {
+    auto deadline = steady_clock::now() + seconds(5);
+    while (steady_clock::now() < deadline)
+    {
+      {
+        lock_guard<mutex> lock (mtx);
+        if (pred())
+          return true;
+      }
+      this_thread::sleep_for(milliseconds(1));
+    }
+    return false;
+  };
+  if (!until([&] { return waiting == kWaiters; }))
+    log_error("%s waiters did not start.", name);
+
+  for (auto & waiter : waiters)
+    SuspendThread(waiter.native_handle());
+  std::atomic<bool> notified (false);
+  thread notifier ([&] {
+      cv.notify_one();
+      cv.notify_all();
+      notified.store(true);
+    });
+  auto deadline = steady_clock::now() + seconds(5);
+  while (!notified.load() && (steady_clock::now() < deadline))
+    this_thread::sleep_for(milliseconds(1));
+  if (!notified.load())
+    log_error("%s notifications waited for suspended waiters.", name);
+  for (auto & waiter : waiters)
+    ResumeThread(waiter.native_handle());
+  notifier.join();
+  if (!until([&] { return returns >= kWaiters; }))
+    log_error("%s::notify_all did not wake every waiter.", name);
+
+//  Every waiter has gone back to sleep by the time the mutex is free.
+  {
+    lock_guard<mutex> lock (mtx);
+    returns = 0;
+  }
+  cv.notify_one();
+  this_thread::sleep_for(milliseconds(50));
+  {
+    lock_guard<mutex> lock (mtx);
+    if (returns != 1)
+      log_error("%s::notify_one woke %d of %d waiters.", name, returns, kWaiters);
+    done = true;
+  }
+  cv.notify_all();
+  for (auto & waiter : waiters)
+    waiter.join();
+  log("\t%s notifies without waiting for its waiters.", name);
+}
+
+//    checked_mutex must report recursive locking and unlocking by a non-owner,
+//  whether or not other threads are waiting, and must stay usable afterwards.
+void test_checked_mutex (void)
+{
+  using mingw_stdthread::checked_mutex;
+  checked_mutex mtx;
+  auto expect_error = [] (std::errc code, char const * what, std::function<void()> f)
+    {
+      try {
+        f();
+        log_error("checked_mutex did not detect %s.", what);
+      } catch (std::system_error & e) {
+        if (e.code() != std::make_error_code(code))
+          log_error("checked_mutex reported %s with the wrong error code.", what);
+      }
+    };
+  mtx.lock();
+  expect_error(std::errc::resource_deadlock_would_occur, "recursive locking",
+               [&mtx] { mtx.lock(); });
+  expect_error(std::errc::resource_deadlock_would_occur, "recursive try_lock",
+               [&mtx] { mtx.try_lock(); });
+  std::thread waiter ([&mtx] (void)
+    {
+      lock_guard<checked_mutex> guard(mtx);
+    });
+  std::thread([&] (void)
+    {
+      expect_error(std::errc::operation_not_permitted, "unlocking by a non-owner",
+                   [&mtx] { mtx.unlock(); });
+    }).join();
+  this_thread::sleep_for(std::chrono::milliseconds(20));
+  mtx.unlock();
+  waiter.join();
+  expect_error(std::errc::operation_not_permitted, "unlocking while unlocked",
+               [&mtx] { mtx.unlock(); });
+  if (!mtx.try_lock())
+    log_error("checked_mutex could not be locked after an error.");
+  else
+    mtx.unlock();
+}
+
+//    queue_mutex hands the lock to its waiters strictly in arrival order. Each
+//  waiter is given time to queue up before the next one starts, and the lock is
+//  held long enough that every waiter exhausts its spin and goes to sleep.
+void test_queue_mutex (void)
+{
+  using mingw_stdthread::queue_mutex;
+  static constexpr int kWaiters = 6;
+  queue_mutex mtx;
+  std::vector<int> order;
+  std::vector<std::thread> waiters;
+  mtx.lock();
+  for (int i = 0; i < kWaiters; ++i)
+  {
+    std::atomic<bool> started (false);
+    waiters.push_back(std::thread([&mtx, &order, &started, i] (void)
+      {
+        started = true;
+        lock_guard<queue_mutex> guard(mtx);
+        order.push_back(i);
+//  Hold the lock long enough for the next waiter to fall asleep too.
+        this_thread::sleep_for(std::chrono::milliseconds(5));
+      }));
+    while (!started)
+      this_thread::yield();
+    this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  mtx.unlock();
+  for (std::thread & waiter : waiters)
+    waiter.join();
+  bool in_order = (order.size() == std::size_t(kWaiters));
+  for (int i = 0; in_order && (i < kWaiters); ++i)
+    in_order = (order[i] == i);
+  if (!in_order)
+    log_error("queue_mutex did not hand the lock to its waiters in arrival order.");
+  if (!mtx.try_lock())
+    log_error("queue_mutex was left locked after its waiters had slept.");
+  else
+    mtx.unlock();
+}
+
+//    If the function passed to call_once throws, the exception must reach the
+//  caller, and the next caller (here, one of the waiting threads) must run the
+//  function again.
+void test_call_once_retry (void)
+{
+  static constexpr int kThreads = 4;
+  once_flag flag;
+  std::atomic<int> attempts (0), completions (0), exceptions (0);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; ++i)
+    threads.push_back(std::thread([&] (void)
+      {
+        try {
+          call_once(flag, [&] (void)
+            {
+              this_thread::sleep_for(std::chrono::milliseconds(20));
+              if (attempts++ == 0)
+                throw std::runtime_error("First attempt fails.");
+              ++completions;
+            });
+        } catch (std::runtime_error &) {
+          ++exceptions;
+        }
+      }));
+  for (std::thread & thr : threads)
+    thr.join();
+  if ((attempts != 2) || (completions != 1) || (exceptions != 1))
+    log_error("call_once made %d attempts, with %d completions and %d exceptions, "
+              "instead of 2, 1 and 1.", int(attempts), int(completions), int(exceptions));
+  call_once(flag, [] { log_error("call_once ran a function after completion."); });
+}
+
+//    lock_many must not deadlock when threads lock overlapping sets of objects
+//  in opposite orders, nor when several objects share a slot.
+template<class Table>
+void test_lock_many (Table & table, char const * name)
+{
+  static constexpr int kIterations = 20000;
+  int objects [4] = {};
+  std::thread first([&table, &objects] (void)
+    {
+      for (int j = 0; j < kIterations; ++j)
+      {
+        table.lock_many({ &objects[0], &objects[1], &objects[2] });
+        ++objects[0]; ++objects[1]; ++objects[2];
+        table.unlock_many({ &objects[0], &objects[1], &objects[2] });
+      }
+    });
+  for (int j = 0; j < kIterations; ++j)
+  {
+    table.lock_many({ &objects[3], &objects[2], &objects[1], &objects[0] });
+    ++objects[0]; ++objects[1]; ++objects[2]; ++objects[3];
+    table.unlock_many({ &objects[3], &objects[2], &objects[1], &objects[0] });
+  }
+  first.join();
+  if ((objects[0] != 2 * kIterations) || (objects[3] != kIterations))
+    log_error("%s lost updates under lock_many.", name);
+  else
+    log("\t%s locks several objects without deadlock.", name);
+}
+
+void test_lock_table (void)
+{
+  using mingw_stdthread::lock_table;
+  lock_table<64> fixed;
+  lock_table<0, mutex, condition_variable> sized (13);
+  lock_table<1> single;
+  if (sized.size() != 13)
+    log_error("lock_table has %d slots instead of 13.", int(sized.size()));
+  static int probes [256];
+  for (int & probe : probes)
+  {
+    if (reinterpret_cast<std::uintptr_t>(&sized.mutex_for(&probe)) % 64 != 0)
+      log_error("lock_table slots are not aligned to cache lines.");
+    if (&fixed.mutex_for(&probe) != &fixed.mutex_for(&probe))
+      log_error("lock_table maps an address to different mutexes.");
+  }
+  test_lock_many(fixed, "lock_table<64>");
+  test_lock_many(sized, "lock_table<0>");
+  test_lock_many(single, "lock_table<1>");
+  bool ready = false;
+  std::thread waiter([&sized, &ready] (void)
+    {
+      unique_lock<mutex> lock (sized.mutex_for(&ready));
+      sized.condition_variable_for(&ready).wait(lock, [&ready] { return ready; });
+    });
+  {
+    lock_guard<mutex> guard (sized.mutex_for(&ready));
+    ready = true;
+  }
+  sized.condition_variable_for(&ready).notify_all();
+  waiter.join();
+}
+
+#if defined(MINGW_STDTHREADS_LOCK_STATS)
+//    Every acquisition should be counted exactly once, including re-entry into
+//  a recursive mutex, and the statistics should survive the exit of the
+//  threads that gathered them.
+void test_lock_stats (void)
+{
+  namespace stats = mingw_stdthread::lock_stats;
+  static constexpr int kThreads = 4;
+  static constexpr int kIterations = 1000;
+  mutex mtx;
+  recursive_mutex rmtx;
+  stats::set_name(&mtx, "test mutex");
+  stats::reset();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; ++i)
+    threads.push_back(std::thread([&mtx, &rmtx] (void)
+      {
+        for (int j = 0; j < kIterations; ++j)
+        {
+          lock_guard<mutex> guard(mtx);
+          lock_guard<recursive_mutex> outer(rmtx);
+          lock_guard<recursive_mutex> inner(rmtx);
+        }
+      }));
+  for (std::thread & thr : threads)
+    thr.join();
+  unsigned long long mtx_count = 0, rmtx_count = 0;
+  for (stats::entry const & e : stats::snapshot())
+  {
+    if (e.lock == &mtx)
+    {
+      mtx_count = e.acquisitions;
+      if (e.name != "test mutex")
+        log_error("Lock statistics lost the name of a mutex.");
+    }
+    else if (e.lock == &rmtx)
+      rmtx_count = e.acquisitions;
+  }
+  if (mtx_count != kThreads * kIterations)
+    log_error("Lock statistics counted %llu of %d acquisitions of a mutex.",
+              mtx_count, kThreads * kIterations);
+  if (rmtx_count != kThreads * kIterations)
+    log_error("Lock statistics counted %llu of %d acquisitions of a recursive mutex.",
+              rmtx_count, kThreads * kIterations);
+  stats::dump(stdout, 5);
+}
+#endif
+
+#if defined(MINGW_STDTHREADS_LOCK_ORDER_CHECKS)
+std::atomic<int> lock_order_reports {0};
+void count_lock_order_report (std::vector<void const *> const & cycle)
+{
+  if (cycle.size() != 2)
+    log_error("Lock-order cycle has %d locks instead of 2.", int(cycle.size()));
+  ++lock_order_reports;
+}
+
+//    Each inverted pair of locks should be reported exactly once, including
+//  pairs that involve a recursive mutex, either side of a shared_mutex, and a
+//  mutex that was released and reacquired by a condition variable. A lock
+//  created where another was destroyed starts with no orders.
+void test_lock_order (void)
+{
+  namespace order = mingw_stdthread::lock_order;
+  order::handler_type previous = order::set_handler(count_lock_order_report);
+  order::set_sample_rate(1);
+  auto expect = [] (int reports, char const * what)
+    {
+      if (lock_order_reports.exchange(0) != reports)
+        log_error("Lock-order checks missed or invented an inversion %s.", what);
+    };
+  mutex a, b;
+  for (int i = 0; i < 2; ++i)
+  {
+    { lock_guard<mutex> first(a); lock_guard<mutex> second(b); }
+    { lock_guard<mutex> first(b); lock_guard<mutex> second(a); }
+  }
+  expect(1, "between two mutexes");
+  order::forget(&a);
+  { lock_guard<mutex> first(b); lock_guard<mutex> second(a); }
+  expect(0, "after forgetting a mutex");
+  { lock_guard<mutex> first(a); lock_guard<mutex> second(b); }
+  expect(1, "after forgetting a mutex");
+
+  recursive_mutex r;
+  mutex c;
+  {
+    lock_guard<recursive_mutex> outer(r);
+    lock_guard<recursive_mutex> inner(r);
+    lock_guard<mutex> second(c);
+  }
+  { lock_guard<mutex> first(c); lock_guard<recursive_mutex> second(r); }
+  expect(1, "involving a recursive mutex");
+
+  shared_mutex s;
+  mutex d;
+  { shared_lock<shared_mutex> first(s); lock_guard<mutex> second(d); }
+  { lock_guard<mutex> first(d); lock_guard<shared_mutex> second(s); }
+  expect(1, "involving a shared_mutex");
+
+#if (WINVER >= _WIN32_WINNT_WIN7)
+//  Free adaptive mutexes are taken on their first attempt, without parking.
+  using mingw_stdthread::windows7::adaptive_mutex;
+  adaptive_mutex h, k;
+  { lock_guard<adaptive_mutex> first(h); lock_guard<adaptive_mutex> second(k); }
+  { lock_guard<adaptive_mutex> first(k); lock_guard<adaptive_mutex> second(h); }
+  expect(1, "between two adaptive mutexes");
+#endif
+
+  mutex e, f;
+  condition_variable cond_var;
+  {
+    unique_lock<mutex> first(e);
+    cond_var.wait_for(first, std::chrono::milliseconds(1));
+    lock_guard<mutex> second(f);
+  }
+  { lock_guard<mutex> first(f); lock_guard<mutex> second(e); }
+  expect(1, "across a condition variable wait");
+//    Reacquiring the condition variable's mutex while holding g orders g
+//  first. The notifier can only lock e once the waiter is asleep, so the wait
+//  ends with a notification rather than a timeout.
+  mutex g;
+  {
+    unique_lock<mutex> first(e);
+    lock_guard<mutex> second(g);
+    std::thread notifier ([&e, &cond_var] (void)
+      {
+        lock_guard<mutex> lock (e);
+        cond_var.notify_all();
+      });
+    cond_var.wait_for(first, std::chrono::seconds(10));
+    first.unlock();
+    notifier.join();
+  }
+  expect(1, "when a condition variable reacquires its mutex");
+
+  {
+    std::aligned_storage<sizeof(mutex), alignof(mutex)>::type storage;
+    mutex * reused = new (&storage) mutex();
+    { lock_guard<mutex> first(*reused); lock_guard<mutex> second(b); }
+    reused->~mutex();
+    reused = new (&storage) mutex();
+    { lock_guard<mutex> first(b); lock_guard<mutex> second(*reused); }
+    expect(0, "for a mutex created where another was destroyed");
+    reused->~mutex();
+  }
+  order::set_sample_rate(0);
+  order::set_handler(previous);
+}
+#endif
+
 #define TEST_SL_MV_CPY(ClassName) \
     static_assert(std::is_standard_layout<ClassName>::value, \
                   "ClassName does not satisfy concept StandardLayoutType."); \
@@ -389,6 +1445,8 @@ int main()
                   "once_flag must not be copy-constructible.");
     static_assert(!std::is_copy_assignable<once_flag>::value,
                   "once_flag must not be copy-assignable.");
+    static_assert(sizeof(once_flag) <= sizeof(void *),
+                  "once_flag should be no larger than a pointer.");
 
 //    With C++ feature level and target Windows version potentially affecting
 //  behavior, make this information visible.
@@ -449,6 +1507,9 @@ int main()
         }
     }
 
+    log("Testing thread attributes...");
+    test_thread_attributes();
+
     std::thread t([](TestMove&& a, const char* b, int c) mutable
     {
         try
@@ -524,9 +1585,119 @@ int main()
     {
         log_error("EXCEPTION in main thread: %s", e.what());
     }
+    {
+      log("Testing condition_variable_any with other locks...");
+      test_condition_variable_any_locks();
+    }
+    {
+      log("Testing sleep and condition variable deadlines...");
+      test_sleep_deadlines();
+      test_condition_variable_deadlines<condition_variable>("condition_variable");
+      test_condition_variable_deadlines<condition_variable_any>("condition_variable_any");
+    }
+#if (WINVER < _WIN32_WINNT_VISTA)
+    {
+      log("Testing the sequence condition variable...");
+      test_sequence_condition_variable<mingw_stdthread::xp::condition_variable_any>("xp::condition_variable_any");
+    }
+#endif
+#if (WINVER >= _WIN32_WINNT_WIN8)
+    {
+      log("Testing the sequence condition variable...");
+      test_sequence_condition_variable<mingw_stdthread::windows8::condition_variable_any>("windows8::condition_variable_any");
+    }
+#endif
+    {
+      log("Testing mutual exclusion under contention...");
+      test_mutual_exclusion<mutex>("mutex");
+      test_mutual_exclusion<recursive_mutex>("recursive_mutex");
+      {
+        recursive_mutex rmtx;
+        rmtx.lock();
+        if (!rmtx.try_lock())
+          log_error("recursive_mutex could not be re-entered by its owner.");
+        rmtx.unlock();
+        std::thread([&rmtx] (void)
+          {
+            if (rmtx.try_lock())
+              log_error("recursive_mutex was locked by a second thread.");
+          }).join();
+        rmtx.unlock();
+      }
+      test_mutual_exclusion<timed_mutex>("timed_mutex");
+      test_mutual_exclusion<shared_mutex>("shared_mutex");
+      test_shared_exclusion<shared_mutex>("shared_mutex");
+      TEST_SL_MV_CPY(mingw_stdthread::portable::shared_mutex)
+      test_mutual_exclusion<mingw_stdthread::portable::shared_mutex>("portable::shared_mutex");
+      test_shared_exclusion<mingw_stdthread::portable::shared_mutex>("portable::shared_mutex");
+      test_writer_preference<mingw_stdthread::portable::shared_mutex>("portable::shared_mutex");
+      test_writer_preference<mingw_stdthread::distributed_shared_mutex>("distributed_shared_mutex");
+      test_writer_preference<mingw_stdthread::upgrade_mutex>("upgrade_mutex");
+      TEST_SL_MV_CPY(mingw_stdthread::distributed_shared_mutex)
+      test_mutual_exclusion<mingw_stdthread::distributed_shared_mutex>("distributed_shared_mutex");
+      test_shared_exclusion<mingw_stdthread::distributed_shared_mutex>("distributed_shared_mutex");
+      test_timed_lock<mingw_stdthread::distributed_shared_mutex>("distributed_shared_mutex");
+      TEST_SL_MV_CPY(mingw_stdthread::phase_fair_shared_mutex)
+      test_mutual_exclusion<mingw_stdthread::phase_fair_shared_mutex>("phase_fair_shared_mutex");
+      test_shared_exclusion<mingw_stdthread::phase_fair_shared_mutex>("phase_fair_shared_mutex");
+      test_writer_preference<mingw_stdthread::phase_fair_shared_mutex>("phase_fair_shared_mutex");
+      TEST_SL_MV_CPY(mingw_stdthread::upgrade_mutex)
+      test_mutual_exclusion<mingw_stdthread::upgrade_mutex>("upgrade_mutex");
+      test_shared_exclusion<mingw_stdthread::upgrade_mutex>("upgrade_mutex");
+      test_timed_lock<mingw_stdthread::upgrade_mutex>("upgrade_mutex");
+      test_upgrade_mutex();
+      test_timed_lock<shared_timed_mutex>("shared_timed_mutex");
+      test_timed_wait_cpu();
+      test_timed_lock<timed_mutex>("timed_mutex");
+      test_timed_lock<recursive_timed_mutex>("recursive_timed_mutex");
+      TEST_SL_MV_CPY(mingw_stdthread::checked_mutex)
+      test_mutual_exclusion<mingw_stdthread::checked_mutex>("checked_mutex");
+      test_checked_mutex();
+      TEST_SL_MV_CPY(mingw_stdthread::queue_mutex)
+      test_mutual_exclusion<mingw_stdthread::queue_mutex>("queue_mutex");
+      test_queue_mutex();
+#if (WINVER >= _WIN32_WINNT_WIN7)
+      TEST_SL_MV_CPY(mingw_stdthread::windows7::adaptive_mutex)
+      test_mutual_exclusion<mingw_stdthread::windows7::adaptive_mutex>("windows7::adaptive_mutex");
+      TEST_SL_MV_CPY(mingw_stdthread::windows7::recursive_mutex)
+#if !defined(MINGW_STDTHREADS_LOCK_ORDER_CHECKS)
+//  Unless each lock must forget its orders when it is destroyed.
+      static_assert(std::is_trivially_destructible<mingw_stdthread::windows7::recursive_mutex>::value,
+                    "windows7::recursive_mutex should be trivially destructible.");
+#endif
+      static_assert(sizeof(mingw_stdthread::windows7::recursive_mutex) <= 16,
+                    "windows7::recursive_mutex should be no larger than 16 bytes.");
+      test_mutual_exclusion<mingw_stdthread::xp::recursive_mutex>("xp::recursive_mutex");
+#endif
+#if (WINVER >= _WIN32_WINNT_WIN8)
+      TEST_SL_MV_CPY(mingw_stdthread::windows8::mutex)
+      test_mutual_exclusion<mingw_stdthread::windows8::mutex>("windows8::mutex");
+#endif
+    }
+    {
+      log("Testing seqlock...");
+      test_seqlock();
+    }
+    {
+      log("Testing lock tables...");
+      test_lock_table();
+    }
+#if defined(MINGW_STDTHREADS_LOCK_STATS)
+    {
+      log("Testing lock statistics...");
+      test_lock_stats();
+    }
+#endif
+#if defined(MINGW_STDTHREADS_LOCK_ORDER_CHECKS)
+    {
+      log("Testing lock-order checks...");
+      test_lock_order();
+    }
+#endif
     once_flag of;
     call_once(of, test_call_once, 1, "test");
     call_once(of, test_call_once, 1, "ERROR! Should not be called second time");
+    test_call_once_retry();
     log("Test complete");
 
     {
@@ -540,6 +1711,12 @@ int main()
       log("Testing <future>'s use of allocators. Should allocate, then deallocate.");
       promise<int> allocated_promise (std::allocator_arg, CustomAllocator<unsigned>());
       allocated_promise.set_value(7);
+      log("Testing the async pool...");
+      test_async_pool();
+      log("Testing thread_pool...");
+      test_thread_pool();
+      log("Testing io_executor...");
+      test_io_executor();
     }
 
 #if defined(__cplusplus) && (__cplusplus >= 202002L)